@@ -0,0 +1,319 @@
+
+/*
+ *
+ * Operating System Design / Diseño de Sistemas Operativos
+ * (c) ARCOS.INF.UC3M.ES
+ *
+ * @file 	async.c
+ * @brief 	Implementation of the queue of requests and its workers.
+ * @date	Last revision 18/10/2026
+ *
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include "filesystem/async.h" // Headers for the asynchronous interface
+
+struct fs_queue {
+  pthread_mutex_t lock;
+  pthread_cond_t submitted;       /* Signaled when requests are submitted or the queue is destroyed */
+  pthread_cond_t completed;       /* Signaled when requests complete */
+  struct fs_request *sq_head;     /* Requests submitted and not started yet, in order */
+  struct fs_request *sq_tail;
+  struct fs_request *cq_head;     /* Requests completed and not reaped yet, in order of completion */
+  struct fs_request *cq_tail;
+  unsigned long sequence;         /* Number of requests submitted */
+  int pending;                    /* Requests submitted and not reaped yet */
+  int running;                    /* Requests taken by the workers and not done yet */
+  int barrier;                    /* Whether a request other than a read or a write is running */
+  int stopping;                   /* Whether the queue is being destroyed */
+  int event_fd;                   /* Its counter is the number of completed requests not reaped yet */
+  int n_workers;
+  pthread_t workers[];
+};
+
+void *async_worker(void *arg);
+struct fs_request *async_reap(fs_queue *queue);
+int async_ready(fs_queue *queue);
+int async_compare(const void *a, const void *b);
+int async_execute(struct fs_request *req);
+
+/*
+ * @brief	Creates a queue of requests and the workers that do them.
+ * @return	The queue if success, NULL otherwise.
+ */
+fs_queue *async_create(int n_workers)
+{
+    if (n_workers <= 0) {
+        perror("async_create: Number of workers isn't valid\n");
+        return NULL;
+    }
+    fs_queue *queue = calloc(1, sizeof(fs_queue)+n_workers*sizeof(pthread_t));
+    if (queue == NULL) {
+        perror("async_create: Couldn't allocate memory for the queue\n");
+        return NULL;
+    }
+    /* Reading the descriptor takes one completion from its counter, so it stays readable while there are more */
+    queue->event_fd = eventfd(0, EFD_NONBLOCK | EFD_SEMAPHORE);
+    if (queue->event_fd == -1) {
+        perror("async_create: Couldn't create the event descriptor\n");
+        free(queue);
+        return NULL;
+    }
+    pthread_mutex_init(&(queue->lock), NULL);
+    pthread_cond_init(&(queue->submitted), NULL);
+    pthread_cond_init(&(queue->completed), NULL);
+    for (int i = 0; i < n_workers; i++) {
+        if (pthread_create(&(queue->workers[i]), NULL, async_worker, queue) != 0) {
+            perror("async_create: Couldn't create the workers\n");
+            queue->n_workers = i;
+            async_destroy(queue);
+            return NULL;
+        }
+    }
+    queue->n_workers = n_workers;
+    return queue;
+}
+
+/*
+ * @brief	Submits a request to a queue, it is done later by one of the workers.
+ * @return	0 if success, -1 otherwise.
+ */
+int async_submit(fs_queue *queue, struct fs_request *req)
+{
+    if (req == NULL || req->op < ASYNC_CREATE || req->op > ASYNC_CLOSE) {
+        perror("async_submit: Request isn't valid\n");
+        return -1;
+    }
+    pthread_mutex_lock(&(queue->lock));
+    if (queue->stopping == 1) {
+        pthread_mutex_unlock(&(queue->lock));
+        perror("async_submit: The queue is being destroyed\n");
+        return -1;
+    }
+    req->sequence = queue->sequence++;
+    req->next = NULL;
+    if (queue->sq_tail != NULL) {
+        queue->sq_tail->next = req;
+    }
+    else {
+        queue->sq_head = req;
+    }
+    queue->sq_tail = req;
+    queue->pending++;
+    pthread_cond_signal(&(queue->submitted));
+    pthread_mutex_unlock(&(queue->lock));
+    return 0;
+}
+
+/*
+ * @brief	Takes a completed request of a queue, without waiting.
+ * @return	The request, NULL if none has completed.
+ */
+struct fs_request *async_poll(fs_queue *queue)
+{
+    pthread_mutex_lock(&(queue->lock));
+    struct fs_request *req = async_reap(queue);
+    pthread_mutex_unlock(&(queue->lock));
+    return req;
+}
+
+/*
+ * @brief	Takes a completed request of a queue, waiting until one completes.
+ * @return	The request, NULL if there is none that has not been reaped.
+ */
+struct fs_request *async_wait(fs_queue *queue)
+{
+    pthread_mutex_lock(&(queue->lock));
+    while (queue->cq_head == NULL && queue->pending > 0) {
+        pthread_cond_wait(&(queue->completed), &(queue->lock));
+    }
+    struct fs_request *req = async_reap(queue);
+    pthread_mutex_unlock(&(queue->lock));
+    return req;
+}
+
+/*
+ * @brief	Gets a descriptor that can be polled by an event loop, it is readable while there are completed requests to reap.
+ * @return	The descriptor.
+ */
+int async_eventfd(fs_queue *queue)
+{
+    return queue->event_fd;
+}
+
+/*
+ * @brief	Does the requests still submitted to a queue and destroys it. Completed requests that were not reaped are dropped.
+ * @return	0 if success, -1 otherwise.
+ */
+int async_destroy(fs_queue *queue)
+{
+    pthread_mutex_lock(&(queue->lock));
+    queue->stopping = 1;
+    pthread_cond_broadcast(&(queue->submitted));
+    pthread_mutex_unlock(&(queue->lock));
+    /* Workers only finish once there are no requests left */
+    int ret = 0;
+    for (int i = 0; i < queue->n_workers; i++) {
+        if (pthread_join(queue->workers[i], NULL) != 0) {
+            ret = -1;
+        }
+    }
+    close(queue->event_fd);
+    pthread_cond_destroy(&(queue->completed));
+    pthread_cond_destroy(&(queue->submitted));
+    pthread_mutex_destroy(&(queue->lock));
+    free(queue);
+    return ret;
+}
+
+/*
+* @brief        Takes batches of requests from the queue and does them, until the queue is destroyed
+* @return       NULL
+*/
+void *async_worker(void *arg) {
+    fs_queue *queue = arg;
+    struct fs_request *batch[ASYNC_BATCH];
+    pthread_mutex_lock(&(queue->lock));
+    while (1) {
+        while (async_ready(queue) == 0 && (queue->sq_head != NULL || queue->stopping == 0)) {
+            pthread_cond_wait(&(queue->submitted), &(queue->lock));
+        }
+        if (queue->sq_head == NULL) {
+            break;
+        }
+        /* Taking several reads and writes at once lets the ones on the same file be done in the order of their offsets,
+           any other request is taken alone and nothing else runs with it */
+        int n = 0;
+        if (queue->sq_head->op != ASYNC_READ && queue->sq_head->op != ASYNC_WRITE) {
+            queue->barrier = 1;
+            batch[n++] = queue->sq_head;
+            queue->sq_head = queue->sq_head->next;
+        }
+        while (queue->barrier == 0 && n < ASYNC_BATCH && queue->sq_head != NULL && (queue->sq_head->op == ASYNC_READ || queue->sq_head->op == ASYNC_WRITE)) {
+            batch[n++] = queue->sq_head;
+            queue->sq_head = queue->sq_head->next;
+        }
+        if (queue->sq_head == NULL) {
+            queue->sq_tail = NULL;
+        }
+        queue->running += n;
+        pthread_mutex_unlock(&(queue->lock));
+
+        qsort(batch, n, sizeof(struct fs_request *), async_compare);
+        int n_reap = 0;
+        for (int i = 0; i < n; i++) {
+            batch[i]->result = async_execute(batch[i]);
+            /* Requests with a callback are done once it returns, the caller may free them then */
+            if (batch[i]->callback != NULL) {
+                batch[i]->callback(batch[i]);
+                batch[i] = NULL;
+            }
+            else {
+                n_reap++;
+            }
+        }
+
+        pthread_mutex_lock(&(queue->lock));
+        queue->pending -= n-n_reap;
+        queue->running -= n;
+        queue->barrier = 0;
+        for (int i = 0; i < n; i++) {
+            if (batch[i] == NULL) {
+                continue;
+            }
+            batch[i]->next = NULL;
+            if (queue->cq_tail != NULL) {
+                queue->cq_tail->next = batch[i];
+            }
+            else {
+                queue->cq_head = batch[i];
+            }
+            queue->cq_tail = batch[i];
+        }
+        if (n_reap > 0) {
+            eventfd_write(queue->event_fd, n_reap);
+        }
+        pthread_cond_broadcast(&(queue->completed));
+        /* Requests held back by this batch may be taken now */
+        pthread_cond_broadcast(&(queue->submitted));
+    }
+    pthread_mutex_unlock(&(queue->lock));
+    return NULL;
+}
+
+/*
+* @brief        Takes the first completed request of a queue, with the lock of the queue taken
+* @return       The request, NULL if none has completed
+*/
+struct fs_request *async_reap(fs_queue *queue) {
+    struct fs_request *req = queue->cq_head;
+    if (req == NULL) {
+        return NULL;
+    }
+    queue->cq_head = req->next;
+    if (queue->cq_head == NULL) {
+        queue->cq_tail = NULL;
+    }
+    queue->pending--;
+    /* One completion less in the counter of the event descriptor */
+    eventfd_t value;
+    eventfd_read(queue->event_fd, &value);
+    return req;
+}
+
+/*
+* @brief        Checks whether the first request submitted can be taken, with the lock of the queue taken. Reads and writes
+*               wait for the request running alone, the rest of the requests also wait for every request taken before them
+* @return       1 if it can be taken, 0 otherwise
+*/
+int async_ready(fs_queue *queue) {
+    if (queue->sq_head == NULL || queue->barrier == 1) {
+        return 0;
+    }
+    if (queue->sq_head->op == ASYNC_READ || queue->sq_head->op == ASYNC_WRITE) {
+        return 1;
+    }
+    return queue->running == 0;
+}
+
+/*
+* @brief        Compares two requests by file system, descriptor, offset and order of submission
+* @return       Negative if the first one goes first, positive otherwise
+*/
+int async_compare(const void *a, const void *b) {
+    const struct fs_request *x = *(struct fs_request * const *) a;
+    const struct fs_request *y = *(struct fs_request * const *) b;
+    if (x->ctx != y->ctx) {
+        return x->ctx < y->ctx ? -1 : 1;
+    }
+    if (x->fd != y->fd) {
+        return x->fd < y->fd ? -1 : 1;
+    }
+    if (x->offset != y->offset) {
+        return x->offset < y->offset ? -1 : 1;
+    }
+    return x->sequence < y->sequence ? -1 : 1;
+}
+
+/*
+* @brief        Does the operation of a request on its file system
+* @return       The value the operation returned
+*/
+int async_execute(struct fs_request *req) {
+    fs_ctx *ctx = req->ctx;
+    switch (req->op) {
+    case ASYNC_CREATE:
+        return ctx != NULL ? ctx_createFile(ctx, req->path) : createFile(req->path);
+    case ASYNC_OPEN:
+        return ctx != NULL ? ctx_openFile(ctx, req->path) : openFile(req->path);
+    case ASYNC_READ:
+        return ctx != NULL ? ctx_preadFile(ctx, req->fd, req->buffer, req->numBytes, req->offset) : preadFile(req->fd, req->buffer, req->numBytes, req->offset);
+    case ASYNC_WRITE:
+        return ctx != NULL ? ctx_pwriteFile(ctx, req->fd, req->buffer, req->numBytes, req->offset) : pwriteFile(req->fd, req->buffer, req->numBytes, req->offset);
+    case ASYNC_CLOSE:
+        return ctx != NULL ? ctx_closeFile(ctx, req->fd) : closeFile(req->fd);
+    }
+    return -1;
+}
@@ -0,0 +1,86 @@
+
+/*
+ *
+ * Operating System Design / Diseño de Sistemas Operativos
+ * (c) ARCOS.INF.UC3M.ES
+ *
+ * @file 	async.h
+ * @brief 	Interface for submitting file system operations and reaping their completions later.
+ * @date	Last revision 18/10/2026
+ *
+ */
+
+
+#ifndef _ASYNC_H_
+#define _ASYNC_H_
+
+#include "filesystem/filesystem.h" // Headers for the core functionality
+
+#define ASYNC_CREATE 0 // createFile(path)
+#define ASYNC_OPEN 1   // openFile(path)
+#define ASYNC_READ 2   // preadFile(fd, buffer, numBytes, offset)
+#define ASYNC_WRITE 3  // pwriteFile(fd, buffer, numBytes, offset)
+#define ASYNC_CLOSE 4  // closeFile(fd)
+#define ASYNC_BATCH 16 // Maximum number of requests a worker takes from the queue at once
+
+/*
+ * Request of an operation. It belongs to the caller, who must keep it until its completion is reaped
+ * or its callback is called. Reads and writes take an explicit offset, the order in which the reads and
+ * writes submitted together are done is not defined. Any other request is done once every request submitted
+ * before it is done, and the requests submitted after it start once it is done.
+ */
+struct fs_request {
+  int op;                                  /* ASYNC_CREATE, ASYNC_OPEN, ASYNC_READ, ASYNC_WRITE or ASYNC_CLOSE */
+  fs_ctx *ctx;                             /* File system of the operation, NULL for the one of mountFS() */
+  char *path;                              /* File of ASYNC_CREATE and ASYNC_OPEN */
+  int fd;                                  /* Descriptor of ASYNC_READ, ASYNC_WRITE and ASYNC_CLOSE */
+  void *buffer;                            /* Data of ASYNC_READ and ASYNC_WRITE */
+  int numBytes;
+  long offset;
+  void (*callback)(struct fs_request *req); /* Called by the worker once the request is done, NULL to reap it with async_poll() or async_wait() */
+  void *user;                              /* Data of the caller, not used by the queue */
+  int result;                              /* Value the operation returned */
+  /* Used by the queue */
+  unsigned long sequence;
+  struct fs_request *next;
+};
+
+typedef struct fs_queue fs_queue;
+
+/*
+ * @brief	Creates a queue of requests and the workers that do them.
+ * @return	The queue if success, NULL otherwise.
+ */
+fs_queue *async_create(int n_workers);
+
+/*
+ * @brief	Submits a request to a queue, it is done later by one of the workers.
+ * @return	0 if success, -1 otherwise.
+ */
+int async_submit(fs_queue *queue, struct fs_request *req);
+
+/*
+ * @brief	Takes a completed request of a queue, without waiting.
+ * @return	The request, NULL if none has completed.
+ */
+struct fs_request *async_poll(fs_queue *queue);
+
+/*
+ * @brief	Takes a completed request of a queue, waiting until one completes.
+ * @return	The request, NULL if there is none that has not been reaped.
+ */
+struct fs_request *async_wait(fs_queue *queue);
+
+/*
+ * @brief	Gets a descriptor that can be polled by an event loop, it is readable while there are completed requests to reap.
+ * @return	The descriptor.
+ */
+int async_eventfd(fs_queue *queue);
+
+/*
+ * @brief	Does the requests still submitted to a queue and destroys it. Completed requests that were not reaped are dropped.
+ * @return	0 if success, -1 otherwise.
+ */
+int async_destroy(fs_queue *queue);
+
+#endif
@@ -10,22 +10,207 @@
  *
  */
  
+/* Structures of the session, defined in filesystem.c */
+struct icache_entry;
+struct open_file;
+struct iov_cursor;
+struct fs_ctx;
+struct alloc_cache;
+
+struct open_file *fd_get(int fd);
+
+int fd_alloc(int inode_id, int flags);
+
+void fd_free(int fd);
+
+void fd_reset();
+
+int read_data(struct open_file *file, unsigned int offset, void *buffer, int numBytes);
+
+int write_data(struct open_file *file, unsigned int offset, void *buffer, int numBytes);
+
+int read_datav(struct open_file *file, unsigned int offset, const struct iovec *iov, int iovcnt);
+
+int write_datav(struct open_file *file, unsigned int offset, const struct iovec *iov, int iovcnt);
+
+int iov_length(const struct iovec *iov, int iovcnt);
+
+void iov_copy(struct iov_cursor *cursor, char *data, int numBytes, int to_iov);
+
 int write_metadata();
 
 int read_metadata();
 
+void pack_inodes(int inode_block, char *buffer);
+
+int journal_commit();
+
+int journal_redirty(int *blocks, int n_blocks);
+
+int journal_op();
+
+int journal_checkpoint();
+
+int journal_empty();
+
+int journal_replay();
+
+void mark_sblock();
+
+void mark_inode(int inode_id);
+
+void hot_sync(int inode_id);
+
+void hot_fill(int inode_block, char *buffer);
+
+int hot_get(int inode_id);
+
+struct Inode *iget(int inode_id);
+
+struct Inode *ihold(int inode_id);
+
+void iput(int inode_id);
+
+void icache_trim();
+
+struct icache_entry *icache_find(int inode_id);
+
+struct icache_entry *icache_load(int inode_id, char *disk_inode);
+
+struct icache_entry *icache_victim();
+
+int iblock_busy(int inode_block);
+
+void icache_unhash(struct icache_entry *entry);
+
+void icache_clear();
+
+void lru_push(struct icache_entry *entry);
+
+void lru_unlink(struct icache_entry *entry);
+
 int ialloc();
 
+void ialloc_undo(int inode_id);
+
 int balloc();
 
+int balloc_run(int n_blocks);
+
+int reserve_block(int inode_id, int logic_block);
+
+int flush_delayed(int inode_id);
+
+void discard_delayed(int inode_id);
+
 int ifree(int inode_id);
 
 int bfree(int block_id);
 
+int bfree_release(int freed);
+
 int namei(char *fname);
 
+int namei_entry(char *fname);
+
+int namei_parent(char *path, char *name);
+
+int lookup(int parent, char *name);
+
+unsigned int name_hash(int parent, char *name);
+
+void name_link(int inode_id);
+
+void name_unlink(int inode_id);
+
+int bloom_position(unsigned int hash, int i);
+
+void bloom_add(unsigned int hash);
+
+void bloom_remove(unsigned int hash);
+
+int bloom_test(unsigned int hash);
+
+void bloom_rebuild();
+
+void dcache_insert(int parent, char *name, int inode_id);
+
+void dcache_remove(int parent, char *name);
+
+void dcache_clear();
+
 int bmap(int inode_id, int offset);
 
-int add_data_block(int inode_id);
+int bmap_cache(struct open_file *file, int offset);
+
+void bmap_invalidate(int inode_id);
+
+void set_block(int inode_id, int logic_block, int block_id);
+
+int migrate_inline(int inode_id);
 
 int remove_links(int inode_id);
+
+void link_add(int link_id, int target);
+
+void link_remove(int link_id, int target);
+
+void lock_init();
+
+void lock_destroy();
+
+void names_lock();
+
+int names_unlock(int ret);
+
+void journal_lock();
+
+int journal_unlock(int ret);
+
+void inode_rdlock(int inode_id);
+
+void inode_wrlock(int inode_id);
+
+int inode_unlock(int inode_id, int ret);
+
+struct open_file *fd_lock(int fd, int write);
+
+int balloc_reserved(int inode_id, int logic_block);
+
+void seq_write_begin(int inode_id);
+
+int seq_write_end(int inode_id, int ret);
+
+void seq_publish(int inode_id);
+
+int read_seq(struct open_file *file, unsigned int offset, void *buffer, int numBytes);
+
+struct fs_ctx *fs_bind(struct fs_ctx *ctx);
+
+int fs_unbind(struct fs_ctx *prev, int ret);
+
+struct fs_ctx *ctx_alloc(const char *device);
+
+void ctx_free(struct fs_ctx *ctx);
+
+int check_inode(int inode_id);
+
+void zero_blocks(int index, void *arg);
+
+void check_files(int index, void *arg);
+
+struct alloc_cache *cache_get();
+
+int cache_fill_blocks(struct alloc_cache *cache);
+
+void cache_reclaim();
+
+void cache_release();
+
+void cache_empty(struct alloc_cache *cache);
+
+void pack_sblock(char *buffer);
+
+int avail_take(int n_blocks);
+
+int map_claim(_Atomic uint64_t *words, int n_bits);
@@ -53,6 +53,41 @@ int bread(char *deviceName, int blockNumber, char *buffer) {
 	return 0;
 }
 
+/*
+ * Reads consecutive blocks from the device, starting at blockNumber, and scatters
+ * them over a list of buffers whose sizes are multiples of BLOCK_SIZE, in a single request.
+ * Returns 0 or -1 in case of error, including short read.
+ */
+int breadv(char *deviceName, int blockNumber, struct iovec *iov, int iovcnt) {
+	int fd = open(deviceName, O_RDONLY);
+
+	if(fd < 0){
+		/* fprintf(stderr, "ERROR: UNABLE TO OPEN DISK FILE %s \n", deviceName); */
+		return -1;
+	}
+
+	ssize_t total = 0;
+	for(int i = 0; i < iovcnt; i++){
+		total = total + iov[i].iov_len;
+	}
+
+	int len = lseek(fd, 0, SEEK_END) + 1;
+	if((BLOCK_SIZE*blockNumber+total) > len) {
+		close(fd);
+		return -1;
+	}
+
+	ssize_t read_result = preadv(fd, iov, iovcnt, BLOCK_SIZE*blockNumber);
+
+	close(fd);
+
+	if(read_result != total){
+		return -1;
+	}
+
+	return 0;
+}
+
 /*
  * Writes a block from a buffer to the device.
  * Returns 0 or -1 in case of error.
@@ -85,3 +120,57 @@ int bwrite(char *deviceName, int blockNumber, char*buffer) {
 
 	return 0;
 }
+
+/*
+ * Writes consecutive blocks to the device, starting at blockNumber, gathering
+ * them from a list of buffers whose sizes are multiples of BLOCK_SIZE, in a single request.
+ * Returns 0 or -1 in case of error.
+ */
+int bwritev(char *deviceName, int blockNumber, struct iovec *iov, int iovcnt) {
+	int fd = open(deviceName, O_WRONLY);
+
+	if(fd < 0){
+		/* fprintf(stderr, "ERROR: UNABLE TO OPEN DISK FILE %s \n", deviceName); */
+		return -1;
+	}
+
+	ssize_t total = 0;
+	for(int i = 0; i < iovcnt; i++){
+		total = total + iov[i].iov_len;
+	}
+
+	int len = lseek(fd, 0, SEEK_END) + 1;
+	if((BLOCK_SIZE*blockNumber+total) > len) {
+		close(fd);
+		return -1;
+	}
+
+	ssize_t write_result = pwritev(fd, iov, iovcnt, BLOCK_SIZE*blockNumber);
+
+	close(fd);
+
+	if(write_result != total){
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Forces the blocks written to the device to reach the storage.
+ * Returns 0 or -1 in case of error.
+ */
+int bsync(char *deviceName) {
+	int fd = open(deviceName, O_WRONLY);
+
+	if(fd < 0){
+		/* fprintf(stderr, "ERROR: UNABLE TO OPEN DISK FILE %s \n", deviceName); */
+		return -1;
+	}
+
+	int result = fdatasync(fd);
+
+	close(fd);
+
+	return result;
+}
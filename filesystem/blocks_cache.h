@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #define BLOCK_SIZE 2048
@@ -37,9 +38,29 @@
  */
 int bread(char *deviceName, int blockNumber, char *buffer);
 
+/*
+ * Reads consecutive blocks from the device, starting at blockNumber, and scatters
+ * them over a list of buffers whose sizes are multiples of BLOCK_SIZE, in a single request.
+ * Returns 0 if correct or -1 in case of error, including short read.
+ */
+int breadv(char *deviceName, int blockNumber, struct iovec *iov, int iovcnt);
+
 /*
  * Writes a block from a buffer to the device.
  * Returns 0 if correct or -1 in case of error.
  */
 int bwrite(char *deviceName, int blockNumber, char*buffer);
+
+/*
+ * Writes consecutive blocks to the device, starting at blockNumber, gathering
+ * them from a list of buffers whose sizes are multiples of BLOCK_SIZE, in a single request.
+ * Returns 0 if correct or -1 in case of error.
+ */
+int bwritev(char *deviceName, int blockNumber, struct iovec *iov, int iovcnt);
+
+/*
+ * Forces the blocks written to the device to reach the storage.
+ * Returns 0 if correct or -1 in case of error.
+ */
+int bsync(char *deviceName);
 #endif
@@ -13,18 +13,121 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/uio.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include "filesystem/filesystem.h" // Headers for the core functionality
 #include "filesystem/auxiliary.h"  // Headers for auxiliary functions
 #include "filesystem/metadata.h"   // Type and structure declaration of the file system
+#include "filesystem/pool.h"       // Headers for the pool of threads
 
-struct Superblock s_block;
-struct Inode i_nodes[N_INODES];
+struct icache_entry {
+  struct Inode inode;              /* Copy of the inode */
+  int inode_id;                    /* Inode the entry holds */
+  int refcount;                    /* Open files using the inode, it can't be evicted while it is not 0 */
+  struct icache_entry *hash_next;  /* Next entry of the same bucket */
+  struct icache_entry *lru_prev;   /* Entry used more recently */
+  struct icache_entry *lru_next;   /* Entry used less recently */
+};
+struct inode_hot {
+  int type[N_INODES];   /* Type of each inode */
+  int target[N_INODES]; /* File each symbolic link points to */
+  int size[N_INODES];   /* Size of each file, entries of each directory */
+};
 struct inode_x {
-  unsigned int open;
-  unsigned int open_integrity;
+  _Alignas(CACHE_LINE) unsigned int opens; /* Number of descriptors the file is open with */
+  unsigned int open_integrity; /* Whether it is open with integrity */
+  int map_version;             /* Changes whenever the blocks of the file change, so that cached runs can be discarded */
+  char *delayed[MAX_FILE_SIZE/BLOCK_SIZE]; /* Data of the blocks written but not flushed yet */
+};
+struct open_file {
+  _Alignas(CACHE_LINE) int inode; /* File the descriptor refers to, -1 if the descriptor is free */
+  int flags;           /* FD_PLAIN or FD_INTEGRITY */
   unsigned int f_seek;
-} inode_x[N_INODES];
-int mounted = 0;
+  int map_logical;     /* First logical block of the last translated run */
+  int map_physical;    /* Data block the run starts at */
+  int map_length;      /* Number of blocks in the run, 0 if nothing is cached */
+  int map_version;     /* Version of the blocks of the file the run was translated from */
+  int next_free;       /* Next descriptor of the free list */
+};
+struct iov_cursor {
+  const struct iovec *iov; /* List of buffers */
+  int iovcnt;              /* Number of buffers */
+  int index;               /* Buffer the next byte goes to or comes from */
+  size_t offset;           /* Position of the next byte inside that buffer */
+};
+struct dentry {
+  int parent;             /* Directory the entry belongs to */
+  char name[NAME_LENGTH]; /* Name of the entry inside the directory */
+  int inode;              /* Inode the name resolves to, -1 if the slot is empty */
+};
+struct bulk_job {
+  struct fs_ctx *ctx;     /* File system the tasks work on, the workers of the pool are bound to it while they run them */
+  int *inodes;            /* File each task works on, NULL for the tasks that work on ranges of blocks */
+  atomic_int failed;      /* Tasks that failed */
+};
+struct alloc_cache {
+  _Alignas(CACHE_LINE) pthread_mutex_t lock;
+  int blocks[CACHE_BLOCKS]; /* Free data blocks taken from the block map, their bits are set but they are written to the disk as free */
+  int n_blocks;
+};
+struct fs_locks {
+  _Alignas(CACHE_LINE) pthread_mutex_t name;   /* Name index, directory cache and the operations that change the namespace */
+  _Alignas(CACHE_LINE) pthread_mutex_t journal; /* Position and sequence of the journal and the operations pending to be committed */
+  pthread_cond_t journal_applied;              /* Signaled when the blocks of a transaction are written to their place */
+  _Alignas(CACHE_LINE) pthread_mutex_t alloc;  /* Allocation caches while they are emptied or written, the maps are changed with atomic operations */
+  _Alignas(CACHE_LINE) pthread_mutex_t icache; /* Inode cache, hot fields and changed inode blocks */
+  _Alignas(CACHE_LINE) pthread_mutex_t fd;     /* Free list of the open file table and open counts */
+  struct {
+    _Alignas(CACHE_LINE) pthread_rwlock_t rw;  /* Contents, size and block pointers of the file */
+  } inode[N_INODES];
+}; /* Taken in this order: name, journal, inode, alloc, icache, fd before icache is also allowed. Each lock has a cache line of its own */
+struct inode_seq {
+  _Alignas(CACHE_LINE) atomic_uint version;           /* Odd while a writer is changing the file */
+  atomic_int size;                                    /* Size of the file */
+  atomic_int inline_data;                             /* Whether the contents are stored in the inode */
+  atomic_int block[MAX_FILE_SIZE/BLOCK_SIZE];         /* Block pointers of the file */
+};
+
+/* Everything a mounted file system keeps in memory, so that several device images can be used at the same time */
+struct fs_ctx {
+  char device[DEVICE_PATH];                 /* Path of the device image */
+  struct Superblock s_block;
+  struct icache_entry *icache_hash[ICACHE_BUCKETS];
+  struct inode_hot hot;                     /* Fields used by lookups and scans, kept apart from the inodes so that going through them touches few cache lines */
+  char hot_loaded[N_INODES/INODES_BLOCK];   /* Whether the fields of each inode block are in hot */
+  struct icache_entry *lru_head;            /* Most recently used inode */
+  struct icache_entry *lru_tail;            /* Least recently used inode */
+  int icache_count;                         /* Number of entries allocated */
+  struct inode_x inode_x[N_INODES];
+  struct open_file file_table[MAX_OPEN_FILES];
+  int free_fd;                              /* First descriptor of the free list, -1 if all of them are in use */
+  struct dentry dcache[DCACHE_SIZE];
+  unsigned char bloom[BLOOM_SIZE];          /* Counting Bloom filter of the names in the file system */
+  atomic_int sblock_dirty;                  /* Whether the superblock changed since it was last written */
+  char iblock_dirty[N_INODES/INODES_BLOCK]; /* Whether each inode block changed since it was last written */
+  int iblock_writing[N_INODES/INODES_BLOCK]; /* Transactions committing each inode block, its inodes stay in memory until it is in its place */
+  atomic_int mounted;
+  _Atomic uint64_t block_words[bitmap_words(MAX_DATA_BLOCKS)]; /* Block map, the one of the superblock is only filled when it is written */
+  _Atomic uint64_t inode_words[bitmap_words(N_INODES)];        /* Inode map, the same way */
+  atomic_int avail_blocks;                  /* Free data blocks of the map that are not promised to delayed blocks */
+  int freed[MAX_DATA_BLOCKS];               /* Blocks freed by transactions that are not committed yet, in the order they were freed */
+  int freed_total;                          /* Blocks ever put in freed, the next one goes in freed_total % MAX_DATA_BLOCKS */
+  int released_total;                       /* Blocks of freed given back to the map, the ones up to freed_total are still pending */
+  int journal_head;                         /* Position in the journal where the next transaction goes */
+  int journal_sequence;                     /* Sequence number of the next transaction */
+  int journal_applied;                      /* Sequence number of the last transaction whose blocks are in their place */
+  int pending_ops;                          /* Operations whose metadata has not been committed yet */
+  struct fs_locks locks;
+  struct alloc_cache caches[ALLOC_CACHES];  /* Free blocks the threads allocate from without touching the shared maps */
+  pthread_once_t locks_once;
+  struct inode_seq inode_seq[N_INODES];     /* Copy of the fields of each open file that reads need, so that they can read them without taking any lock */
+};
+struct fs_ctx default_ctx = { .device = DEVICE_IMAGE, .journal_head = 1, .journal_sequence = 1, .locks_once = PTHREAD_ONCE_INIT }; /* File system of the functions without a context */
+_Thread_local struct fs_ctx *fs = &default_ctx; /* File system the calling thread is working on */
+atomic_int n_threads;                           /* Threads that have allocated blocks, each one gets the next allocation cache */
+_Thread_local int cache_slot = -1;              /* Allocation cache of the calling thread, -1 until it allocates */
+_Thread_local int names_held;                   /* Times the calling thread took the lock of the namespace, inodes are only dropped from memory while it is taken */
 
 /*
  * @brief 	Generates the proper file system structure in a storage device, as designed by the student.
@@ -44,40 +147,88 @@ int mkFS(long deviceSize)
 
     /* Compute the total number of blocks in the device */
     int disk_blocks = deviceSize/BLOCK_SIZE;    
+    names_lock();
 
     /* Initialize values of superblock */
-    memset(&s_block, 0, BLOCK_SIZE);
-    s_block.magic_number = MAGIC_NUM;
-    s_block.n_inodes = N_INODES;
+    memset(&fs->s_block, 0, BLOCK_SIZE);
+    fs->s_block.magic_number = MAGIC_NUM;
+    fs->s_block.n_inodes = N_INODES;
     /* We will have 16 inodes per block, so 3 blocks for the inodes in total */
-    s_block.n_blocks_inodes = N_INODES/INODES_BLOCK;
-    s_block.n_data_blocks = disk_blocks-1-s_block.n_blocks_inodes;
-    s_block.first_data_block = 1 + s_block.n_blocks_inodes;
-    s_block.device_size = deviceSize;
-
-    /* Initialize all values of i_nodes to 0 */
-    memset(i_nodes, 0, sizeof(i_nodes)); 
+    fs->s_block.n_blocks_inodes = N_INODES/INODES_BLOCK;
+    fs->s_block.n_data_blocks = disk_blocks-1-fs->s_block.n_blocks_inodes-JOURNAL_BLOCKS;
+    fs->s_block.first_data_block = 1 + fs->s_block.n_blocks_inodes;
+    fs->s_block.device_size = deviceSize;
+    /* The journal takes the last blocks of the device, after the data blocks */
+    fs->s_block.journal_start = disk_blocks-JOURNAL_BLOCKS;
+    fs->s_block.n_journal_blocks = JOURNAL_BLOCKS;
+    for (int i = 0; i < INDEX_BUCKETS; i++) {
+        fs->s_block.index_head[i] = -1;
+    }
+    for (int i = 0; i < N_INODES; i++) {
+        fs->s_block.link_head[i] = -1;
+        fs->s_block.link_next[i] = -1;
+    }
+    memset(fs->block_words, 0, sizeof(fs->block_words));
+    memset(fs->inode_words, 0, sizeof(fs->inode_words));
+    fs->avail_blocks = fs->s_block.n_data_blocks;
+    fs->freed_total = 0;
+    fs->released_total = 0;
+    /* Blocks cached from the old device are not valid anymore */
+    for (int i = 0; i < ALLOC_CACHES; i++) {
+        fs->caches[i].n_blocks = 0;
+    }
 
-    /* Run command to create the disk file */
-    char command[20];
-    sprintf(command, "./create_disk %d", disk_blocks);    
-    system(command);
+    /* Inodes cached from the old device are not valid anymore, the new ones are all empty */
+    icache_clear();
+    memset(&fs->hot, 0, sizeof(fs->hot));
+    memset(fs->hot_loaded, 1, sizeof(fs->hot_loaded));
+    /* Session data (open files and cached translations and names) refers to the old inodes */
+    memset(fs->inode_x, 0, sizeof(fs->inode_x));
+    fd_reset();
+    dcache_clear();
+    memset(fs->bloom, 0, sizeof(fs->bloom));
 
-    /* Write file system metadata to disk */
-    if (write_metadata() == -1){
-        return -1;
+    /* Create the device image, or resize the one that exists, so that it has exactly the blocks of the file system */
+    int fd = open(fs->device, O_CREAT | O_WRONLY, 0666);
+    if (fd == -1 || ftruncate(fd, (off_t) disk_blocks*BLOCK_SIZE) == -1) {
+        perror("mkFS: Error creating the device image\n");
+        if (fd != -1) {
+            close(fd);
+        }
+        return names_unlock(-1);
     }
+    close(fd);
 
-    /* Initialize all data blocks to 0 */
+    /* Write file system metadata to disk, all of it is new and all inodes are empty */
     char buffer[BLOCK_SIZE];
     memset(buffer, 0, sizeof(buffer));
-    for (int i = 0; i < s_block.n_data_blocks; i++) {
-	if (bwrite(DEVICE_IMAGE, i+s_block.first_data_block, buffer) == -1) {
-            perror("mkFS: Error initializing data blocks to 0\n");
-            return -1;
+    for (int i = 0; i < fs->s_block.n_blocks_inodes; i++) {
+        if (bwrite(fs->device, 1+i, buffer) == -1) {
+            perror("mkFS: Error initializing inodes to 0\n");
+            return names_unlock(-1);
         }
     }
-    return 0;
+    memset(fs->iblock_dirty, 0, sizeof(fs->iblock_dirty));
+    mark_sblock();
+    if (write_metadata() == -1){
+        return names_unlock(-1);
+    }
+    /* The journal starts empty */
+    fs->journal_sequence = 1;
+    fs->journal_applied = 0;
+    fs->pending_ops = 0;
+    if (journal_checkpoint() == -1) {
+        return names_unlock(-1);
+    }
+
+    /* Initialize all data blocks to 0, the ranges of blocks are written in parallel */
+    struct bulk_job job = { .ctx = fs };
+    pool_run((fs->s_block.n_data_blocks+ZERO_BLOCKS-1)/ZERO_BLOCKS, zero_blocks, &job);
+    if (atomic_load(&(job.failed)) > 0) {
+        perror("mkFS: Error initializing data blocks to 0\n");
+        return names_unlock(-1);
+    }
+    return names_unlock(0);
 }
 
 /*
@@ -86,17 +237,23 @@ int mkFS(long deviceSize)
  */
 int mountFS(void)
 {
+    names_lock();
     /* There's an error if we try to mount a system that is already mounted */
-    if (mounted == 1) {
+    if (fs->mounted == 1) {
 	perror("Error mountFS: The file system is already mounted\n");
-        return -1;
+        return names_unlock(-1);
+    }
+    /* Bring the metadata on the disk up to date with the transactions committed in the journal */
+    if (journal_replay() == -1) {
+        return names_unlock(-1);
     }
     /* Read metadata from disk to memory */
     if (read_metadata() == -1) {
-        return -1;
+        return names_unlock(-1);
     }
-    mounted = 1;
-    return 0;
+    fd_reset();
+    fs->mounted = 1;
+    return names_unlock(0);
 }
 
 /*
@@ -105,19 +262,53 @@ int mountFS(void)
  */
 int unmountFS(void)
 {
+    names_lock();
     /* You can't unmount a system that isn't mounted */
-    if (mounted == 0) {
+    if (fs->mounted == 0) {
 	perror("unmountFS: The file system is already unmounted\n");
-        return -1;
+        return names_unlock(-1);
     }
-    /* Write metadata from memory to disk, so that it perdures between unmount and mount */
-    if (write_metadata() == -1) {
-        return -1;
+    /* Give a physical block to all the data that is still in memory */
+    for (int i = 0; i < N_INODES; i++) {
+        inode_wrlock(i);
+        if (inode_unlock(i, flush_delayed(i)) == -1) {
+            return names_unlock(-1);
+        }
+    }
+    /* Blocks left in the allocation caches go back to the map */
+    cache_reclaim();
+    /* Write metadata from memory to disk, so that it perdures between unmount and mount, and empty the journal */
+    if (journal_commit() == -1 || journal_checkpoint() == -1) {
+        return names_unlock(-1);
     }
     /* Delete data from current session */
-    memset(inode_x, 0, sizeof(inode_x));
-    mounted = 0;
-    return 0;
+    memset(fs->inode_x, 0, sizeof(fs->inode_x));
+    fd_reset();
+    icache_clear();
+    fs->mounted = 0;
+    return names_unlock(0);
+}
+
+/*
+ * @brief 	Writes to the device the data and metadata that changed since the last synchronization.
+ * @return 	0 if success, -1 otherwise.
+ */
+int fs_sync(void)
+{
+    names_lock();
+    if (fs->mounted == 0) {
+        perror("fs_sync: The file system is not mounted\n");
+        return names_unlock(-1);
+    }
+    /* Delayed data needs its blocks before the inodes pointing to them are written */
+    for (int i = 0; i < N_INODES; i++) {
+        inode_wrlock(i);
+        if (inode_unlock(i, flush_delayed(i)) == -1) {
+            return names_unlock(-1);
+        }
+    }
+    /* Only the blocks of metadata that changed are written, through the journal */
+    return names_unlock(journal_commit());
 }
 
 /*
@@ -126,44 +317,55 @@ int unmountFS(void)
  */
 int createFile(char *fileName)
 {
+    names_lock();
     /* Error checking in case the file system isn't mounted or the file already exists */
-    if (mounted == 0) {
+    if (fs->mounted == 0) {
         perror("createFile: The file system is not mounted\n");
-        return -2;
+        return names_unlock(-2);
     }
     if (namei(fileName) >= 0) {
         perror("createFile: File name already exists\n");
-        return -1;
+        return names_unlock(-1);
     }
-    /* Allocate an inode and a data block for the file */
-    int inode_id, block_id;
+    /* The directory where the file goes has to exist */
+    char name[NAME_LENGTH];
+    int parent = namei_parent(fileName, name);
+    if (parent == -1) {
+        perror("createFile: Path is not valid\n");
+        return names_unlock(-2);
+    }
+    /* Allocate an inode for the file, its data block is not allocated until the file outgrows the inode */
+    int inode_id;
     inode_id = ialloc();
     if (inode_id == -1) {
-        return -2;
-    }
-    block_id = balloc();
-    if (block_id == -1) {
-        ifree(inode_id);
-        return -2;
-    }
-    /* Initialize inode values */
-    i_nodes[inode_id].type = REGULAR;
-    strncpy(i_nodes[inode_id].name, fileName, NAME_LENGTH);
-    /* When we create a file it will only use the direct block, indirect blocks will be initialized to 1 to show that they are not in use */
-    i_nodes[inode_id].direct_block = block_id; 
-    i_nodes[inode_id].indirect_block1 = -1;
-    i_nodes[inode_id].indirect_block2 = -1;
-    i_nodes[inode_id].indirect_block3 = -1;	
-    i_nodes[inode_id].indirect_block4 = -1;		
-    i_nodes[inode_id].size = 0;
-    i_nodes[inode_id].includes_integrity = 0;
-
-    /* Initialize values of inode in memory of current session too */
-    inode_x[inode_id].f_seek = 0;    
-    inode_x[inode_id].open = 0; /* We could change this to open directly a file when it is created */
-    inode_x[inode_id].open_integrity = 0;
+        return names_unlock(-2);
+    }
+    /* Initialize inode values, it is kept in memory meanwhile */
+    struct Inode *inode = ihold(inode_id);
+    if (inode == NULL) {
+        ialloc_undo(inode_id);
+        return names_unlock(-2);
+    }
+    inode->type = REGULAR;
+    strcpy(inode->name, name);
+    inode->parent = parent;
+    name_link(inode_id);
+    /* When we create a file its contents are stored inline, blocks will be initialized to -1 to show that they are not in use */
+    inode->inline_data = 1;
+    inode->direct_block = -1; 
+    inode->indirect_block1 = -1;
+    inode->indirect_block2 = -1;
+    inode->indirect_block3 = -1;	
+    inode->indirect_block4 = -1;		
+    inode->size = 0;
+    inode->includes_integrity = 0;
+    inode->nlink = 1;
+    iput(inode_id);
 
-    return inode_id;
+    if (journal_op() == -1) {
+        return names_unlock(-2);
+    }
+    return names_unlock(inode_id);
 }
 
 /*
@@ -172,56 +374,88 @@ int createFile(char *fileName)
  */
 int removeFile(char *fileName)
 {
+    names_lock();
     /* Check for errors in case the file system isn't mounted or if the file doesn't exist */
-    if (mounted == 0) {
+    if (fs->mounted == 0) {
         perror("removeFile: The file system is not mounted\n");
-        return -2;
+        return names_unlock(-2);
     }
-    int inode_id = namei(fileName);
-    if (inode_id < 0) {
+    int entry = namei_entry(fileName);
+    if (entry < 0) {
         perror("removeFile: File does not exist\n");
-        return -1;
+        return names_unlock(-1);
     } 
     /* We can't use this function to delete symbolic links */
-    if (i_nodes[inode_id].type != REGULAR) {
-        perror("removeFile: File is not of type regular\n");
-        return -2;
-    }
-
-    /* Free the blocks, only freeing indirect blocks if they are being used by the inode (they are different than -1) */  
-    if (bfree(i_nodes[inode_id].direct_block) == -1) {
-        return -2;
-    }
-    if (i_nodes[inode_id].indirect_block1 != -1) {
-        if (bfree(i_nodes[inode_id].indirect_block1) == -1) {
-            return -2;
-        }
+    int inode_id = entry;
+    if (fs->hot.type[hot_get(entry)] == HARD_LINK) {
+        inode_id = fs->hot.target[entry];
     }
-    if (i_nodes[inode_id].indirect_block2 != -1) {
-        if (bfree(i_nodes[inode_id].indirect_block2) == -1) {
-            return -2;
+    else if (fs->hot.type[entry] != REGULAR) {
+        perror("removeFile: File is not of type regular\n");
+        return names_unlock(-2);
+    }
+    /* The file is kept in memory while its hard link goes away, which may make room in the inode cache */
+    struct Inode *inode = ihold(inode_id);
+    if (inode == NULL) {
+        return names_unlock(-2);
+    }
+    /* A hard link goes away with its inode, the name of the file itself is just unlinked */
+    if (inode_id != entry) {
+        if (ifree(entry) == -1) {
+            iput(inode_id);
+            return names_unlock(-2);
         }
     }
-    if (i_nodes[inode_id].indirect_block3 != -1) {
-        if (bfree(i_nodes[inode_id].indirect_block3) == -1) {
-            return -2;
+    else {
+        name_unlink(entry);
+        inode->name[0] = '\0';
+        mark_inode(entry);
+    }
+    /* The file stays while it has other names, threads using it through a descriptor finish before it changes */
+    inode_wrlock(inode_id);
+    inode->nlink--;
+    mark_inode(inode_id);
+    if (inode->nlink > 0) {
+        inode_unlock(inode_id, 0);
+        iput(inode_id);
+        if (journal_op() == -1) {
+            return names_unlock(-2);
         }
+        return names_unlock(0);
     }
-    if (i_nodes[inode_id].indirect_block4 != -1) {
-        if (bfree(i_nodes[inode_id].indirect_block4) == -1) {
-            return -2;
+
+    /* Otherwise its blocks go away */
+    seq_write_begin(inode_id);
+    /* Free the blocks, only freeing them if they were allocated to the inode (they are not negative) */  
+    int n_freed = 0;
+    for (int i = 0; i < MAX_FILE_SIZE/BLOCK_SIZE; i++) {
+        int block_id = bmap(inode_id, i*BLOCK_SIZE);
+        n_freed += block_id >= 0;
+        if (block_id >= 0 && bfree(block_id) == -1) {
+            iput(inode_id);
+            return names_unlock(inode_unlock(inode_id, seq_write_end(inode_id, -2)));
         }
     }
+    /* Data that was never flushed is dropped, releasing its reservation */
+    discard_delayed(inode_id);
     /* When we delete a file we also delete all the symbolic links to that file */
     if (remove_links(inode_id) == -1) {
 	perror("removeFile: Error deleting symbolic links to file\n");
-        return -2;		
+        iput(inode_id);
+        return names_unlock(inode_unlock(inode_id, seq_write_end(inode_id, -2)));		
     }
-    /* Free the inode */
+    /* Free the inode and drop the hold on it */
     if (ifree(inode_id) == -1) {
-        return -2;
+        iput(inode_id);
+        return names_unlock(inode_unlock(inode_id, seq_write_end(inode_id, -2)));
     }
-    return 0;
+    iput(inode_id);
+    inode_unlock(inode_id, seq_write_end(inode_id, 0));
+    /* Freed blocks can only be allocated again once the removal is committed, so it doesn't wait for the rest of its group */
+    if ((n_freed > 0 ? journal_commit() : journal_op()) == -1) {
+        return names_unlock(-2);
+    }
+    return names_unlock(0);
 }
 
 /*
@@ -230,30 +464,32 @@ int removeFile(char *fileName)
  */
 int openFile(char *fileName)
 {
+    names_lock();
     /* Check for errors if the file system ins't mounted or the file doesn't exist */
-    if (mounted == 0) {
+    if (fs->mounted == 0) {
         perror("openFile: The file system is not mounted\n");
-        return -2;
+        return names_unlock(-2);
     }
     int inode_id = namei(fileName);
     if (inode_id < 0) {
         perror("openFile: File does not exist\n");
-        return -1;
+        return names_unlock(-1);
     }
     /* When we open a symbolic link we open the file the link points to */
-    if (i_nodes[inode_id].type == SYM_LINK) {
-        inode_id = i_nodes[inode_id].inode;
+    if (fs->hot.type[hot_get(inode_id)] == SYM_LINK) {
+        inode_id = fs->hot.target[inode_id];
+    }
+    /* Directories have no contents to read or write */
+    if (fs->hot.type[hot_get(inode_id)] == DIRECTORY) {
+        perror("openFile: File is a directory\n");
+        return names_unlock(-2);
     }
     /* Check if the file was already opened with integrity */
-    if (inode_x[inode_id].open_integrity == 1) {
+    if (fs->inode_x[inode_id].open_integrity == 1) {
         perror("openFile: File is already opened with integrity\n");
     }
-    /* Move the pointer f_seek to the beginning of the file and set open field to 1*/
-    inode_x[inode_id].f_seek = 0;    
-    inode_x[inode_id].open = 1;
-    inode_x[inode_id].open_integrity = 0;
-
-    return inode_id;
+    /* Each open gets its own descriptor, with the pointer f_seek at the beginning of the file */
+    return names_unlock(fd_alloc(inode_id, FD_PLAIN));
 }
 
 /*
@@ -263,31 +499,30 @@ int openFile(char *fileName)
 int closeFile(int fileDescriptor)
 {
     /* Check for errors */
-    if (mounted == 0) {
+    if (fs->mounted == 0) {
         perror("closeFile: The file system is not mounted\n");
         return -2;
     }
-    if (fileDescriptor < 0 || fileDescriptor >= N_INODES) {
+    struct open_file *file = fd_lock(fileDescriptor, 1);
+    if (file == NULL) {
         perror("closeFile: File descriptor is not valid\n");
         return -1;
     }
-    /* As we don't have the name of the file we have to check that the fileDescriptor corresponds to a created file */
-    if (bitmap_getbit(s_block.inode_map, fileDescriptor) == 0) {
-	perror("closeFile: File descriptor does not correspond to an existing iNode\n");
-        return -1;		
-    }
-    /* If we close from a symbolic link we close the file it points to */
-    if (i_nodes[fileDescriptor].type == SYM_LINK) {
-        fileDescriptor = i_nodes[fileDescriptor].inode;
-    }
+    int inode_id = file->inode;
     /* We cannot close without integrity a file that was opened with it */
-    if (inode_x[fileDescriptor].open_integrity == 1) {
+    if (file->flags == FD_INTEGRITY) {
         perror("closeFile: File was opened with integrity\n");
+        return inode_unlock(inode_id, -1);
+    }
+    /* Now that the file is complete we can choose where its new blocks go */
+    if (flush_delayed(inode_id) == -1) {
+        return inode_unlock(inode_id, -1);
+    }
+    fd_free(fileDescriptor);
+    inode_unlock(inode_id, 0);
+    if (journal_op() == -1) {
         return -1;
     }
-    /* Set vale of open to 0 and reset f_seek*/
-    inode_x[fileDescriptor].open = 0;
-    inode_x[fileDescriptor].f_seek = 0;
     return 0;
 }
 
@@ -298,58 +533,31 @@ int closeFile(int fileDescriptor)
 int readFile(int fileDescriptor, void *buffer, int numBytes)
 {
     /* Check for errors in arguments */
-    if (mounted == 0) {
+    if (fs->mounted == 0) {
         perror("readFile: The file system is not mounted\n");
         return -1;
     }
-    if (fileDescriptor < 0 || fileDescriptor >= N_INODES) {
-        perror("readFile: File descriptor is not valid\n");
-        return -1;    
-    }
-    if (bitmap_getbit(s_block.inode_map, fileDescriptor) == 0) {
-	perror("readFile: File descriptor does not correspond to an existing iNode\n");
-        return -1;		
-    }
     /* Size cannot be negative */
     if (numBytes < 0) {
         perror("readFile: Size isn't valid\n");
         return -1;
     }
-    /* If we try to read from a symbolic link we access the file it points to */
-    if (i_nodes[fileDescriptor].type == SYM_LINK) {
-        fileDescriptor = i_nodes[fileDescriptor].inode;
+    /* Other threads can read the file meanwhile, but the seek pointer of a descriptor is used by one thread at a time */
+    struct open_file *file = fd_get(fileDescriptor);
+    if (file == NULL) {
+        perror("readFile: File descriptor is not valid\n");
+        return -1;    
     }
-	
-    /* If the data the user wants to reads exceeds the size of the file we limit it to the maximum space available */
-    if (inode_x[fileDescriptor].f_seek+numBytes > i_nodes[fileDescriptor].size)
-        numBytes = i_nodes[fileDescriptor].size - inode_x[fileDescriptor].f_seek;
-
-    char b[BLOCK_SIZE];
-    int block_id, block_offset, buffer_offset = 0, bytes_read = 0;
-    
-    while (numBytes > 0) {
-        /* Get in which block and where in the block we have to read */
-        block_id = bmap(fileDescriptor, inode_x[fileDescriptor].f_seek);
-        block_offset = inode_x[fileDescriptor].f_seek % BLOCK_SIZE;  
-
-        /* As we will read block by block if the number of bytes to read exceeds the size of the block we limit it */
-        int toRead;
-        if (numBytes <= BLOCK_SIZE-block_offset)
-            toRead = numBytes;
-        else
-            toRead = BLOCK_SIZE-block_offset;
-
-        /* Read the block from the disk and write it into the buffer from the last position we wrote (indicated by the buffer offset) */
-        bread(DEVICE_IMAGE, s_block.first_data_block+block_id, b);
-        memmove(buffer+buffer_offset, b+block_offset, toRead);
-
-        /* Update positions of pointers and variables */
-        buffer_offset += toRead;
-        inode_x[fileDescriptor].f_seek += toRead;
-        numBytes -= toRead;  
-        bytes_read += toRead;      
+    /* The file is read without any lock, unless it keeps changing or its data is in memory */
+    int bytes_read = read_seq(file, file->f_seek, buffer, numBytes);
+    if (bytes_read == -1) {
+        if (fd_lock(fileDescriptor, 0) == NULL) {
+            perror("readFile: File descriptor is not valid\n");
+            return -1;
+        }
+        bytes_read = inode_unlock(file->inode, read_data(file, file->f_seek, buffer, numBytes));
     }
-
+    file->f_seek += bytes_read;
     return bytes_read;
 }
 
@@ -360,74 +568,26 @@ int readFile(int fileDescriptor, void *buffer, int numBytes)
 int writeFile(int fileDescriptor, void *buffer, int numBytes)
 {
     /* Check for errors */
-    if (mounted == 0) {
+    if (fs->mounted == 0) {
         perror("writeFile: The file system isn't mounted\n");
         return -2;
     }
-    if (fileDescriptor < 0 || fileDescriptor >= N_INODES) {
+    if (numBytes < 0) {
+        perror("writeFile: Size isn't valid\n");
+        return -1;
+    }
+    struct open_file *file = fd_lock(fileDescriptor, 1);
+    if (file == NULL) {
         perror("writeFile: File descriptor isn't valid\n");
         return -1;    
     }
-    if (bitmap_getbit(s_block.inode_map, fileDescriptor) == 0) {
-	perror("writeFile: File descriptor doesn't correspond to an existing iNode\n");
-    return -1;		
-    }
-    if (i_nodes[fileDescriptor].type == SYM_LINK) {
-        fileDescriptor = i_nodes[fileDescriptor].inode;
-    }
-    if (inode_x[fileDescriptor].open == 0 && inode_x[fileDescriptor].open_integrity == 0) {
-        perror("writeFile: File is not openend\n");
+    int bytes_written = write_data(file, file->f_seek, buffer, numBytes);
+    file->f_seek += bytes_written;
+    inode_unlock(file->inode, 0);
+    /* The journal is shared by all the files, it is only used without the lock of any of them */
+    if (journal_op() == -1) {
         return -1;
     }
-    if (numBytes < 0) {
-        perror("writeFile: Size isn't valid\n");
-    }
-    
-    char b[BLOCK_SIZE];
-    int block_id, block_offset, bytes_written = 0;
-
-    /* If the data the user wants to write exceeds the size of the file we limit it to the maximum space available */
-    if (inode_x[fileDescriptor].f_seek+numBytes > MAX_FILE_SIZE)
-        numBytes = MAX_FILE_SIZE - inode_x[fileDescriptor].f_seek;
-   
-    /* Check if we need to allocate a new indirect block for the file (when the file already has filled the previous block and the pointer is in the last position) */
-    if (numBytes > 0 && i_nodes[fileDescriptor].size % BLOCK_SIZE == 0 && i_nodes[fileDescriptor].size > 0 && i_nodes[fileDescriptor].size == inode_x[fileDescriptor].f_seek) {
-        if (add_data_block(fileDescriptor) == -1) {
-            return bytes_written; /* If we can't add a data block it's because there is no more space in the disk so we will return 0 */
-        }
-    }  
-
-    while (numBytes > 0) {
-        /* Get the block where we have to write and where in the block */
-        block_id = bmap(fileDescriptor, inode_x[fileDescriptor].f_seek);  
-        block_offset = inode_x[fileDescriptor].f_seek % BLOCK_SIZE;  
-      
-        /* Limit the bytes to write to the capacity of the block */
-        int toWrite;
-        if (numBytes <= BLOCK_SIZE-block_offset)
-            toWrite = numBytes;
-        else
-            toWrite = BLOCK_SIZE-block_offset;
-
-        /* Read the block from the disk, add the data and write it again in the disk */
-        bread(DEVICE_IMAGE, s_block.first_data_block+block_id, b);
-        memmove(b+block_offset, buffer, toWrite);
-        bwrite(DEVICE_IMAGE, s_block.first_data_block+block_id, b);
-
-        /* Update the values of the pointers and variables */
-        inode_x[fileDescriptor].f_seek += toWrite;
-        i_nodes[fileDescriptor].size += toWrite;
-        numBytes -= toWrite;
-        bytes_written += toWrite;
-        
-        /* Check if we need to allocate another data block, when we are at the end of the file and there are still bytes to be written */
-        if (inode_x[fileDescriptor].f_seek % BLOCK_SIZE == 0 && numBytes > 0 && i_nodes[fileDescriptor].size == inode_x[fileDescriptor].f_seek) {
-            if (add_data_block(fileDescriptor) == -1) {
-                return bytes_written; /* If we can't add a new data block it means there is no more space in the disk so we return the bytes written */
-            }
-        }
-    }
-    
     return bytes_written;
 }
 
@@ -438,40 +598,280 @@ int writeFile(int fileDescriptor, void *buffer, int numBytes)
 int lseekFile(int fileDescriptor, long offset, int whence)
 {
     /* Check for errors */
-    if (mounted == 0) {
+    if (fs->mounted == 0) {
         perror("lseekFile: The file system is not mounted\n");
         return -2;
     }
-    if (fileDescriptor < 0 || fileDescriptor >= N_INODES) {
+    struct open_file *file = fd_lock(fileDescriptor, 0);
+    if (file == NULL) {
         perror("lseekFile: File descriptor is not valid\n");
         return -1;    
     }
-    if (bitmap_getbit(s_block.inode_map, fileDescriptor) == 0) {
-        perror("lseekFile: File descriptor does not correspond to an existing iNode\n");
-        return -1;		
-    }
-    if (i_nodes[fileDescriptor].type == SYM_LINK) {
-        fileDescriptor = i_nodes[fileDescriptor].inode;
-    }
     /* When the pointer is set to the current position, update adding the offset */
     if (whence == FS_SEEK_CUR) {
         /* Check that the pointer doesn't go outside of the limits of the file */
-        if (inode_x[fileDescriptor].f_seek + offset > i_nodes[fileDescriptor].size || inode_x[fileDescriptor].f_seek + offset < 0) {
+        if (file->f_seek + offset > iget(file->inode)->size || file->f_seek + offset < 0) {
             perror("lseekFile: Cannot move pointer outside of the limits of the file\n");
-            return -1;
+            return inode_unlock(file->inode, -1);
         }
-        inode_x[fileDescriptor].f_seek += offset;
+        file->f_seek += offset;
     }
     /* Set the pointer to the end of the file */
     else if (whence == FS_SEEK_END) {
-        inode_x[fileDescriptor].f_seek = i_nodes[fileDescriptor].size;
+        file->f_seek = iget(file->inode)->size;
     } 
     /* Set te pointer to te beginning of the file */
     else if (whence == FS_SEEK_BEGIN) {
-        inode_x[fileDescriptor].f_seek = 0;
+        file->f_seek = 0;
     }
     else {
         perror("lseekFile: The value of the argument whence is not valid");
+        return inode_unlock(file->inode, -1);
+    }
+    return inode_unlock(file->inode, 0);
+}
+
+/*
+ * @brief	Reads a number of bytes from a position of a file, without moving its seek pointer.
+ * @return	Number of bytes properly read, -1 in case of error.
+ */
+int preadFile(int fileDescriptor, void *buffer, int numBytes, long offset)
+{
+    if (fs->mounted == 0) {
+        perror("preadFile: The file system is not mounted\n");
+        return -1;
+    }
+    if (numBytes < 0 || offset < 0) {
+        perror("preadFile: Size or offset isn't valid\n");
+        return -1;
+    }
+    struct open_file *file = fd_get(fileDescriptor);
+    if (file == NULL) {
+        perror("preadFile: File descriptor is not valid\n");
+        return -1;    
+    }
+    /* Nothing can be read beyond the maximum size of a file */
+    if (offset >= MAX_FILE_SIZE) {
+        return 0;
+    }
+    int bytes_read = read_seq(file, offset, buffer, numBytes);
+    if (bytes_read != -1) {
+        return bytes_read;
+    }
+    if (fd_lock(fileDescriptor, 0) == NULL) {
+        perror("preadFile: File descriptor is not valid\n");
+        return -1;
+    }
+    /* Several threads can read through the same descriptor at once, so each one translates blocks with a descriptor of its own */
+    struct open_file local = { .inode = file->inode };
+    return inode_unlock(local.inode, read_data(&local, offset, buffer, numBytes));
+}
+
+/*
+ * @brief	Writes a number of bytes into a position of a file, without moving its seek pointer.
+ * @return	Number of bytes properly written, -1 in case of error.
+ */
+int pwriteFile(int fileDescriptor, void *buffer, int numBytes, long offset)
+{
+    if (fs->mounted == 0) {
+        perror("pwriteFile: The file system isn't mounted\n");
+        return -1;
+    }
+    if (numBytes < 0 || offset < 0) {
+        perror("pwriteFile: Size or offset isn't valid\n");
+        return -1;
+    }
+    struct open_file *file = fd_lock(fileDescriptor, 1);
+    if (file == NULL) {
+        perror("pwriteFile: File descriptor isn't valid\n");
+        return -1;    
+    }
+    if (offset >= MAX_FILE_SIZE) {
+        return inode_unlock(file->inode, 0);
+    }
+    int bytes_written = inode_unlock(file->inode, write_data(file, offset, buffer, numBytes));
+    if (journal_op() == -1) {
+        return -1;
+    }
+    return bytes_written;
+}
+
+/*
+ * @brief	Reads from a file into a list of buffers, filling each one before the next.
+ * @return	Number of bytes properly read, -1 in case of error.
+ */
+int readvFile(int fileDescriptor, const struct iovec *iov, int iovcnt)
+{
+    if (fs->mounted == 0) {
+        perror("readvFile: The file system is not mounted\n");
+        return -1;
+    }
+    if (iovcnt < 0 || (iovcnt > 0 && iov == NULL)) {
+        perror("readvFile: List of buffers isn't valid\n");
+        return -1;
+    }
+    struct open_file *file = fd_lock(fileDescriptor, 0);
+    if (file == NULL) {
+        perror("readvFile: File descriptor is not valid\n");
+        return -1;    
+    }
+    /* The whole list is read as a single request */
+    int bytes_read = read_datav(file, file->f_seek, iov, iovcnt);
+    file->f_seek += bytes_read;
+    return inode_unlock(file->inode, bytes_read);
+}
+
+/*
+ * @brief	Writes into a file the contents of a list of buffers, one after the other.
+ * @return	Number of bytes properly written, -1 in case of error.
+ */
+int writevFile(int fileDescriptor, const struct iovec *iov, int iovcnt)
+{
+    if (fs->mounted == 0) {
+        perror("writevFile: The file system isn't mounted\n");
+        return -1;
+    }
+    if (iovcnt < 0 || (iovcnt > 0 && iov == NULL)) {
+        perror("writevFile: List of buffers isn't valid\n");
+        return -1;
+    }
+    struct open_file *file = fd_lock(fileDescriptor, 1);
+    if (file == NULL) {
+        perror("writevFile: File descriptor isn't valid\n");
+        return -1;    
+    }
+    /* Pieces that fall in the same block are written to it together */
+    int bytes_written = write_datav(file, file->f_seek, iov, iovcnt);
+    file->f_seek += bytes_written;
+    inode_unlock(file->inode, 0);
+    if (journal_op() == -1) {
+        return -1;
+    }
+    return bytes_written;
+}
+
+/*
+ * @brief	Allocates the data blocks of a range of a file in advance, contiguously when possible. The size of the file does not change.
+ * @return	0 if success, -1 in case of error, -2 if the file system is not mounted.
+ */
+int fallocateFile(int fileDescriptor, long offset, long length)
+{
+    /* Check for errors */
+    if (fs->mounted == 0) {
+        perror("fallocateFile: The file system is not mounted\n");
+        return -2;
+    }
+    if (offset < 0 || length <= 0 || offset+length > MAX_FILE_SIZE) {
+        perror("fallocateFile: Range isn't valid\n");
+        return -1;
+    }
+    struct open_file *file = fd_lock(fileDescriptor, 1);
+    if (file == NULL) {
+        perror("fallocateFile: File descriptor is not valid\n");
+        return -1;    
+    }
+    int inode_id = file->inode;
+    seq_write_begin(inode_id);
+    /* Preallocated data is always stored in blocks, as the file is open its inode is in memory */
+    struct Inode *inode = iget(inode_id);
+    if (inode->inline_data == 1) {
+        if (migrate_inline(inode_id) == -1) {
+            return inode_unlock(inode_id, seq_write_end(inode_id, -1));
+        }
+    }
+
+    /* Count the blocks of the range that don't have a physical block yet, delayed blocks already have their space reserved */
+    int first_block = offset/BLOCK_SIZE;
+    int last_block = (offset+length-1)/BLOCK_SIZE;
+    int n_blocks = 0, n_delayed = 0;
+    for (int i = first_block; i <= last_block; i++) {
+        int block_id = bmap(inode_id, i*BLOCK_SIZE);
+        if (block_id == DELAYED_BLOCK) {
+            n_delayed++;
+        }
+        if (block_id < 0) {
+            n_blocks++;
+        }
+    }
+    if (n_blocks == 0) {
+        return inode_unlock(inode_id, seq_write_end(inode_id, 0));
+    }
+    /* Either the whole range is allocated or nothing is, so later writes to it cannot run out of space. The blocks are reserved at once, so other threads cannot take them meanwhile */
+    if (avail_take(n_blocks-n_delayed) == -1) {
+        cache_reclaim();
+        if (avail_take(n_blocks-n_delayed) == -1) {
+            perror("fallocateFile: There are not enough free blocks\n");
+            return inode_unlock(inode_id, seq_write_end(inode_id, -1));
+        }
+    }
+    int run = balloc_run(n_blocks), run_end = run+n_blocks;
+    int claimed[MAX_FILE_SIZE/BLOCK_SIZE];
+    int i;
+    for (i = first_block; i <= last_block; i++) {
+        claimed[i] = -1;
+        int block_id = bmap(inode_id, i*BLOCK_SIZE);
+        if (block_id >= 0) {
+            continue;
+        }
+        /* Take the blocks from the run found in a single pass over the map, or one by one if there is no run long enough */
+        if (run != -1) {
+            claimed[i] = run++;
+            set_block(inode_id, i, claimed[i]);
+        }
+        else {
+            claimed[i] = balloc_reserved(inode_id, i);
+            if (claimed[i] == -1) {
+                break;
+            }
+        }
+        /* Free blocks are zeroed in the disk, only delayed data has to be written. It stays in memory until the whole range is allocated */
+        if (block_id == DELAYED_BLOCK && bwrite(fs->device, fs->s_block.first_data_block+claimed[i], fs->inode_x[inode_id].delayed[i]) == -1) {
+            perror("fallocateFile: Couldn't write block data\n");
+            break;
+        }
+    }
+    if (i <= last_block) {
+        /* Nothing of the range is kept: the blocks attached go back to the map and the delayed data to memory */
+        int n_written = 0;
+        for (int j = first_block; j <= i; j++) {
+            if (claimed[j] < 0) {
+                continue;
+            }
+            if (fs->inode_x[inode_id].delayed[j] != NULL) {
+                /* The block may have the data, so it is deleted once the change is committed like any other freed block */
+                set_block(inode_id, j, DELAYED_BLOCK);
+                bfree(claimed[j]);
+                n_written++;
+            }
+            else {
+                set_block(inode_id, j, -1);
+                bitmap_setbit_atomic(fs->block_words, claimed[j], 0);
+            }
+        }
+        /* So does the part of the run that wasn't used */
+        for (; run != -1 && run < run_end; run++) {
+            bitmap_setbit_atomic(fs->block_words, run, 0);
+        }
+        mark_sblock();
+        /* The reservation is given back, the blocks that had data are counted when they are released */
+        atomic_fetch_add(&(fs->avail_blocks), n_blocks-n_delayed-n_written);
+        cache_release();
+        inode_unlock(inode_id, seq_write_end(inode_id, 0));
+        if ((n_written > 0 ? journal_commit() : journal_op()) == -1) {
+            perror("fallocateFile: Error committing metadata\n");
+        }
+        return -1;
+    }
+    for (i = first_block; i <= last_block; i++) {
+        if (claimed[i] >= 0 && fs->inode_x[inode_id].delayed[i] != NULL) {
+            free(fs->inode_x[inode_id].delayed[i]);
+            fs->inode_x[inode_id].delayed[i] = NULL;
+        }
+    }
+    /* The blocks the thread cached and didn't use are left for the rest */
+    cache_release();
+    inode_unlock(inode_id, seq_write_end(inode_id, 0));
+    if (journal_op() == -1) {
         return -1;
     }
     return 0;
@@ -484,43 +884,61 @@ int lseekFile(int fileDescriptor, long offset, int whence)
 
 int checkFile (char * fileName)
 {
+    names_lock();
     /* Check for errors */
-    if (mounted == 0) {
+    if (fs->mounted == 0) {
         perror("checkFile: The file system is not mounted\n");
-        return -2;
+        return names_unlock(-2);
     }
     int inode_id = namei(fileName);
     if (inode_id < 0) {
         perror("checkFile: File does not exist\n");
-        return -2;
+        return names_unlock(-2);
     }
     /* Access the actual file in case the argument is a symbolic link */
-    if (i_nodes[inode_id].type == SYM_LINK) {
-        inode_id = i_nodes[inode_id].inode;
+    if (fs->hot.type[hot_get(inode_id)] == SYM_LINK) {
+        inode_id = fs->hot.target[inode_id];
     }
     /* We can only perform this check if the file includes integrity and is closed */
-    if (i_nodes[inode_id].includes_integrity == 0) {
+    struct Inode *inode = iget(inode_id);
+    if (inode == NULL || inode->includes_integrity == 0) {
         perror("checkFile: File doesn't iclude integrity\n");
-        return -2;
+        return names_unlock(-2);
     }
-    if (inode_x[inode_id].open == 1 || inode_x[inode_id].open_integrity == 1) {
+    if (fs->inode_x[inode_id].opens > 0) {
         perror("checkFile: File is openend\n");
-        return -2;
+        return names_unlock(-2);
     }
     
-    /* Get the hash value of the current contents of the file */
-    unsigned char buffer[i_nodes[inode_id].size];
-    lseekFile(inode_id, 0, FS_SEEK_BEGIN);
-    readFile(inode_id, buffer, i_nodes[inode_id].size);
-    uint32_t check = CRC32(buffer, i_nodes[inode_id].size);  
+    return names_unlock(check_inode(inode_id));
+}
 
-    /* Check that the value corresponds to the one already stored in the inode */
-    if (check == i_nodes[inode_id].integrity) { /* Not corrupted */
-        return 0;
+/*
+ * @brief	Checks the integrity of all the closed files that include it, several files at a time.
+ * @return	Number of corrupted files, -1 in case of error.
+ */
+int checkAllFiles(void)
+{
+    names_lock();
+    if (fs->mounted == 0) {
+        perror("checkAllFiles: The file system is not mounted\n");
+        return names_unlock(-1);
     }
-    else {  /* Corrupted */
-        return -1;
+    /* Files can't be opened or removed while the name lock is taken, so they don't change while they are checked */
+    int inodes[N_INODES], n_files = 0;
+    for (int i = 0; i < N_INODES; i++) {
+        if (bitmap_getbit_atomic(fs->inode_words, i) == 0 || fs->hot.type[hot_get(i)] != REGULAR || fs->inode_x[i].opens > 0) {
+            continue;
+        }
+        /* An inode that can't be read is reported as corrupted */
+        struct Inode *inode = iget(i);
+        if (inode == NULL || inode->includes_integrity == 1) {
+            inodes[n_files++] = i;
+        }
     }
+    struct bulk_job job = { .ctx = fs, .inodes = inodes };
+    pool_run(n_files, check_files, &job);
+    return names_unlock(atomic_load(&(job.failed)));
 }
 
 /*
@@ -530,41 +948,52 @@ int checkFile (char * fileName)
 
 int includeIntegrity (char * fileName)
 {
+    names_lock();
     /* Check for errors */
-    if (mounted == 0) {
+    if (fs->mounted == 0) {
         perror("includeIntegrity: The file system isn't mounted\n");
-        return -2;
+        return names_unlock(-2);
     }
     int inode_id = namei(fileName);
     if (inode_id < 0) {
         perror("includeIntegrity: File doesn't exist\n");
-        return -1;
+        return names_unlock(-1);
     }
     /* Access the actual file in case it is a symbolic link */
-    if (i_nodes[inode_id].type == SYM_LINK) {
-        inode_id = i_nodes[inode_id].inode;
+    if (fs->hot.type[hot_get(inode_id)] == SYM_LINK) {
+        inode_id = fs->hot.target[inode_id];
+    }
+    struct Inode *inode = iget(inode_id);
+    if (inode == NULL) {
+        return names_unlock(-2);
     }
-    if (i_nodes[inode_id].includes_integrity == 1) {
+    if (inode->includes_integrity == 1) {
         perror("includeIntegrity: File already icludes integrity\n");
-        return -2;
+        return names_unlock(-2);
     }
     /* We can only perform this check if the file is closed */
-    if (inode_x[inode_id].open == 1 || inode_x[inode_id].open_integrity == 1) {
+    if (fs->inode_x[inode_id].opens > 0) {
         perror("includeIntegrity: File is openend\n");
-        return -2;
+        return names_unlock(-2);
     }
 
-    /* The inode now includes integrity */
-    i_nodes[inode_id].includes_integrity = 1;
+    /* The inode now includes integrity, it is kept in memory while its contents are read */
+    ihold(inode_id);
+    inode->includes_integrity = 1;
 
     /* Compute the crc value from the contents of the file and store it in the corresponding field */
-    unsigned char buffer[i_nodes[inode_id].size];
-    lseekFile(inode_id, 0, FS_SEEK_BEGIN);
-    readFile(inode_id, buffer, i_nodes[inode_id].size);
-    uint32_t integrity = CRC32(buffer, i_nodes[inode_id].size);
-    i_nodes[inode_id].integrity = integrity;
+    struct open_file file = { .inode = inode_id };
+    unsigned char buffer[inode->size];
+    read_data(&file, 0, buffer, inode->size);
+    uint32_t integrity = CRC32(buffer, inode->size);
+    inode->integrity = integrity;
+    mark_inode(inode_id);
+    iput(inode_id);
 
-    return 0;
+    if (journal_op() == -1) {
+        return names_unlock(-2);
+    }
+    return names_unlock(0);
 }
 
 /*
@@ -573,41 +1002,40 @@ int includeIntegrity (char * fileName)
  */
 int openFileIntegrity(char *fileName)
 {
+    names_lock();
     /* Check for errors */
-    if (mounted == 0) {
+    if (fs->mounted == 0) {
         perror("openFileIntegrity: The file system isn't mounted\n");
-        return -3;
+        return names_unlock(-3);
     }
     int inode_id = namei(fileName);
     if (inode_id < 0) {
         perror("openFileIntegrity: File doesn't exist\n");
-        return -1;
+        return names_unlock(-1);
     }
     /* In case it is a symbolic link access the actual file */
-    if (i_nodes[inode_id].type == SYM_LINK) {
-        inode_id = i_nodes[inode_id].inode;
+    if (fs->hot.type[hot_get(inode_id)] == SYM_LINK) {
+        inode_id = fs->hot.target[inode_id];
     }
-    if (inode_x[inode_id].open == 1 || inode_x[inode_id].open_integrity == 1) {
+    if (fs->inode_x[inode_id].opens > 0) {
         perror("checkFile: File is already open\n");
-        return -2;
+        return names_unlock(-2);
     }
-    if (i_nodes[inode_id].includes_integrity == 0) {
+    struct Inode *inode = iget(inode_id);
+    if (inode == NULL || inode->includes_integrity == 0) {
         perror("openFileIntegrity: File does not iclude integrity\n");
-        return -3;
+        return names_unlock(-3);
     }
     /* Use the function checkFile to know if the file is corrupted */
     if (checkFile(fileName) == -1) {
         perror("openFileIntegrity: File is corrupted\n");
-        return -2;
+        return names_unlock(-2);
     }
-    /* If it isn't set the values of the session and open the file */
+    /* If it isn't open the file with a descriptor of its own */
     else if (checkFile(fileName) == 0) {
-        inode_x[inode_id].f_seek = 0;    
-        inode_x[inode_id].open = 0;
-        inode_x[inode_id].open_integrity = 1;      
-        return inode_id;  
+        return names_unlock(fd_alloc(inode_id, FD_INTEGRITY));
     }
-    return -3; /* In case there's an error in checkFile */
+    return names_unlock(-3); /* In case there's an error in checkFile */
 }
 
 /*
@@ -617,49 +1045,129 @@ int openFileIntegrity(char *fileName)
 int closeFileIntegrity(int fileDescriptor)
 {
     /* Check for errors */
-    if (mounted == 0) {
+    if (fs->mounted == 0) {
         perror("closeFileIntegrity: The file system isn't mounted\n");
         return -1;
     }
-    if (fileDescriptor < 0 || fileDescriptor >= N_INODES) {
+    struct open_file *file = fd_lock(fileDescriptor, 1);
+    if (file == NULL) {
         perror("closeFileIntegrity: File descriptor isn't valid\n");
         return -1;    
     }
-    if (bitmap_getbit(s_block.inode_map, fileDescriptor) == 0) {
-	perror("closeFileIntegrity: File descriptor doesn't correspond to an existing iNode");
-        return -1;		
-    }
-    /* If the inode is a symbolic link we access the file it points to */
-    if (i_nodes[fileDescriptor].type == SYM_LINK) {
-        fileDescriptor = i_nodes[fileDescriptor].inode;
-    }  
+    int inode_id = file->inode;
     /* If the file was opened without integrity it can't be closed with it */
-    if (inode_x[fileDescriptor].open == 1) {
+    if (file->flags != FD_INTEGRITY) {
         perror("closeFileIntegrity: File was opened without integrity\n");
-        return -1;    
+        return inode_unlock(inode_id, -1);    
     }
-    /* File has to include integrity and have been opened with it */
-    if (i_nodes[fileDescriptor].includes_integrity == 0) {
+    /* File has to include integrity, as it is open its inode is in memory */
+    struct Inode *inode = iget(inode_id);
+    if (inode->includes_integrity == 0) {
         perror("closeFileIntegrity: File does not iclude integrity\n");
-        return -1;
+        return inode_unlock(inode_id, -1);
     } 
-    if (inode_x[fileDescriptor].open_integrity == 0) {
-        perror("closeFileIntegrity: File is not open\n");
-        return -1;
-    }
     
     /* Compute the integrity of the file and update its field */
-    unsigned char buffer[i_nodes[fileDescriptor].size];
-    lseekFile(fileDescriptor, 0, FS_SEEK_BEGIN);
-    readFile(fileDescriptor, buffer, i_nodes[fileDescriptor].size);
-    uint32_t integrity = CRC32(buffer, i_nodes[fileDescriptor].size);
-    i_nodes[fileDescriptor].integrity = integrity;
+    unsigned char buffer[inode->size];
+    read_data(file, 0, buffer, inode->size);
+    uint32_t integrity = CRC32(buffer, inode->size);
+    inode->integrity = integrity;
+    mark_inode(inode_id);
 
-    /* Close file and reset f_seek */
-    inode_x[fileDescriptor].open_integrity = 0;
-    inode_x[fileDescriptor].f_seek = 0; 
+    if (flush_delayed(inode_id) == -1) {
+        return inode_unlock(inode_id, -1);
+    }
+    fd_free(fileDescriptor);
+    inode_unlock(inode_id, 0);
 
-    return 0;
+    if (journal_op() == -1) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * @brief	Creates a new directory, provided its parent directory exists and the name is not in use.
+ * @return	0 if success, -1 if the name already exists, -2 in case of error.
+ */
+int mkDir(char *path)
+{
+    names_lock();
+    /* Error checking in case the file system isn't mounted or the name already exists */
+    if (fs->mounted == 0) {
+        perror("mkDir: The file system is not mounted\n");
+        return names_unlock(-2);
+    }
+    if (namei(path) >= 0) {
+        perror("mkDir: Name already exists\n");
+        return names_unlock(-1);
+    }
+    char name[NAME_LENGTH];
+    int parent = namei_parent(path, name);
+    if (parent == -1) {
+        perror("mkDir: Path is not valid\n");
+        return names_unlock(-2);
+    }
+    int inode_id = ialloc();
+    if (inode_id == -1) {
+        return names_unlock(-2);
+    }
+    /* A directory has no data, its entries are the inodes that have it as parent */
+    struct Inode *inode = ihold(inode_id);
+    if (inode == NULL) {
+        ialloc_undo(inode_id);
+        return names_unlock(-2);
+    }
+    inode->type = DIRECTORY;
+    strcpy(inode->name, name);
+    inode->parent = parent;
+    inode->direct_block = -1; 
+    inode->indirect_block1 = -1;
+    inode->indirect_block2 = -1;
+    inode->indirect_block3 = -1;	
+    inode->indirect_block4 = -1;		
+    inode->nlink = 1;
+    name_link(inode_id);
+    iput(inode_id);
+    if (journal_op() == -1) {
+        return names_unlock(-2);
+    }
+    return names_unlock(0);
+}
+
+/*
+ * @brief	Deletes an empty directory.
+ * @return	0 if success, -1 if the directory does not exist, -2 in case of error.
+ */
+int rmDir(char *path)
+{
+    names_lock();
+    /* Error checking in case the file system isn't mounted or the directory doesn't exist */
+    if (fs->mounted == 0) {
+        perror("rmDir: The file system is not mounted\n");
+        return names_unlock(-2);
+    }
+    int inode_id = namei(path);
+    if (inode_id < 0) {
+        perror("rmDir: Directory does not exist\n");
+        return names_unlock(-1);
+    }
+    if (fs->hot.type[hot_get(inode_id)] != DIRECTORY) {
+        perror("rmDir: Name does not correspond to a directory\n");
+        return names_unlock(-2);
+    }
+    /* Only empty directories can be removed */
+    if (fs->hot.size[hot_get(inode_id)] != 0) {
+        perror("rmDir: Directory is not empty\n");
+        return names_unlock(-2);
+    }
+    if (ifree(inode_id) == -1) {
+        return names_unlock(-2);
+    }
+    if (journal_op() == -1) {
+        return names_unlock(-2);
+    }
+    return names_unlock(0);
 }
 
 /*
@@ -668,37 +1176,57 @@ int closeFileIntegrity(int fileDescriptor)
  */
 int createLn(char *fileName, char *linkName)
 {
+    names_lock();
     /* Error checking in case the file system isn't mounted or the link already exists */
-    if (mounted == 0) {
+    if (fs->mounted == 0) {
         perror("createLn: The file system is not mounted\n");
-        return -2;
+        return names_unlock(-2);
     }
     if (namei(linkName) >= 0) {
         perror("createLn: Name is already in use\n");
-        return -2;
+        return names_unlock(-2);
     }
     int file_inode = namei(fileName);
     if (file_inode < 0) {
         perror("createLn: File does not exist\n");
-        return -1;
+        return names_unlock(-1);
     }
-    /* Symbolic links to other symbolic links are not allowed to avoid cycles */
-    if (i_nodes[file_inode].type == SYM_LINK) {
-        perror("createLn: Cannot create a symbolic link to another symbolic link");
-        return -2;
+    /* Symbolic links to other symbolic links or to directories are not allowed to avoid cycles */
+    if (fs->hot.type[hot_get(file_inode)] != REGULAR) {
+        perror("createLn: Can only create a symbolic link to a regular file");
+        return names_unlock(-2);
     }
-    /* Allocate an inode and a data block for the file */
+    char name[NAME_LENGTH];
+    int parent = namei_parent(linkName, name);
+    if (parent == -1) {
+        perror("createLn: Path is not valid\n");
+        return names_unlock(-2);
+    }
+    /* Allocate an inode for the link */
     int inode_id;
     inode_id = ialloc();
     if (inode_id == -1) {
-        return -2;
+        return names_unlock(-2);
     }
     /* Initialize inode values, the rest of the fields will not be used for symbolic links */
-    i_nodes[inode_id].type = SYM_LINK;
-    strcpy(i_nodes[inode_id].name, linkName);
-    i_nodes[inode_id].inode = file_inode;
+    struct Inode *inode = ihold(inode_id);
+    if (inode == NULL) {
+        ialloc_undo(inode_id);
+        return names_unlock(-2);
+    }
+    inode->type = SYM_LINK;
+    strcpy(inode->name, name);
+    inode->parent = parent;
+    inode->inode = file_inode;
+    inode->nlink = 1;
+    name_link(inode_id);
+    link_add(inode_id, file_inode);
+    iput(inode_id);
     
-    return 0;
+    if (journal_op() == -1) {
+        return names_unlock(-2);
+    }
+    return names_unlock(0);
 }
 
 /*
@@ -707,253 +1235,2433 @@ int createLn(char *fileName, char *linkName)
  */
 int removeLn(char *linkName)
 {
+    names_lock();
     /* Error checking in case the file system is not mounted or the link already exists */
-    if (mounted == 0) {
+    if (fs->mounted == 0) {
         perror("removeLn: The file system is not mounted\n");
-        return -2;
+        return names_unlock(-2);
     }
     int inode_id = namei(linkName);
     if (inode_id < 0) {
         perror("removeLn: Link name does not exist\n");
-        return -1;
+        return names_unlock(-1);
     }
     /* Cannot use this function to remove a regular file */
-    if (i_nodes[inode_id].type != SYM_LINK) {
+    if (fs->hot.type[hot_get(inode_id)] != SYM_LINK) {
         perror("removeLn: Name does not correspond to a symbolic link");
-        return -2;
+        return names_unlock(-2);
     }
     /* Free the inode */
     if (ifree(inode_id) == -1) {
-        return -2;
+        return names_unlock(-2);
+    }
+    if (journal_op() == -1) {
+        return names_unlock(-2);
+    }
+    return names_unlock(0);
+}
+
+/*
+ * @brief	Creates a hard link, another name for an existing regular file.
+ * @return	0 if success, -1 if file does not exist, -2 in case of error.
+ */
+int createHardLn(char *fileName, char *linkName)
+{
+    names_lock();
+    if (fs->mounted == 0) {
+        perror("createHardLn: The file system is not mounted\n");
+        return names_unlock(-2);
+    }
+    if (namei(linkName) >= 0) {
+        perror("createHardLn: Name is already in use\n");
+        return names_unlock(-2);
+    }
+    int file_inode = namei(fileName);
+    if (file_inode < 0) {
+        perror("createHardLn: File does not exist\n");
+        return names_unlock(-1);
+    }
+    if (fs->hot.type[hot_get(file_inode)] != REGULAR) {
+        perror("createHardLn: Can only create a hard link to a regular file");
+        return names_unlock(-2);
+    }
+    char name[NAME_LENGTH];
+    int parent = namei_parent(linkName, name);
+    if (parent == -1) {
+        perror("createHardLn: Path is not valid\n");
+        return names_unlock(-2);
+    }
+    struct Inode *file = ihold(file_inode);
+    if (file == NULL) {
+        return names_unlock(-2);
+    }
+    /* The name needs an entry in the name index, which is kept by inode */
+    int inode_id = ialloc();
+    struct Inode *inode = inode_id == -1 ? NULL : ihold(inode_id);
+    if (inode == NULL) {
+        if (inode_id != -1) {
+            ialloc_undo(inode_id);
+        }
+        iput(file_inode);
+        return names_unlock(-2);
+    }
+    inode->type = HARD_LINK;
+    strcpy(inode->name, name);
+    inode->parent = parent;
+    inode->inode = file_inode;
+    name_link(inode_id);
+    iput(inode_id);
+    /* The file has one more name */
+    file->nlink++;
+    mark_inode(file_inode);
+    iput(file_inode);
+
+    if (journal_op() == -1) {
+        return names_unlock(-2);
+    }
+    return names_unlock(0);
+}
+
+/*
+ * @brief 	Generates the proper file system structure in the device image given.
+ * @return 	0 if success, -1 otherwise.
+ */
+int ctx_mkFS(const char *device, long deviceSize)
+{
+    struct fs_ctx *ctx = ctx_alloc(device);
+    if (ctx == NULL) {
+        return -1;
+    }
+    struct fs_ctx *prev = fs_bind(ctx);
+    int ret = fs_unbind(prev, mkFS(deviceSize));
+    ctx_free(ctx);
+    return ret;
+}
+
+/*
+ * @brief 	Mounts the file system of the device image given.
+ * @return 	The context of the file system if success, NULL otherwise.
+ */
+fs_ctx *ctx_mountFS(const char *device)
+{
+    struct fs_ctx *ctx = ctx_alloc(device);
+    if (ctx == NULL) {
+        return NULL;
+    }
+    struct fs_ctx *prev = fs_bind(ctx);
+    if (fs_unbind(prev, mountFS()) == -1) {
+        ctx_free(ctx);
+        return NULL;
     }
+    return ctx;
+}
+
+/*
+ * @brief 	Unmounts a file system, the context can't be used anymore.
+ * @return 	0 if success, -1 otherwise.
+ */
+int ctx_unmountFS(fs_ctx *ctx)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    if (fs_unbind(prev, unmountFS()) == -1) {
+        return -1;
+    }
+    ctx_free(ctx);
     return 0;
 }
 
+/*
+ * @brief	Writes to the device the data and metadata that changed since the last synchronization.
+ * @return	0 if success, -1 otherwise.
+ */
+int ctx_fs_sync(fs_ctx *ctx)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, fs_sync());
+}
+
+/*
+ * @brief	Creates a new file, provided it it doesn't exist in the file system.
+ * @return	0 if success, -1 if the file already exists, -2 in case of error.
+ */
+int ctx_createFile(fs_ctx *ctx, char *path)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, createFile(path));
+}
+
+/*
+ * @brief	Deletes a file, provided it exists in the file system.
+ * @return	0 if success, -1 if the file does not exist, -2 in case of error..
+ */
+int ctx_removeFile(fs_ctx *ctx, char *path)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, removeFile(path));
+}
+
+/*
+ * @brief	Opens an existing file.
+ * @return	The file descriptor if possible, -1 if file does not exist, -2 in case of error..
+ */
+int ctx_openFile(fs_ctx *ctx, char *path)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, openFile(path));
+}
+
+/*
+ * @brief	Closes a file.
+ * @return	0 if success, -1 otherwise.
+ */
+int ctx_closeFile(fs_ctx *ctx, int fileDescriptor)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, closeFile(fileDescriptor));
+}
+
+/*
+ * @brief	Reads a number of bytes from a file and stores them in a buffer.
+ * @return	Number of bytes properly read, -1 in case of error.
+ */
+int ctx_readFile(fs_ctx *ctx, int fileDescriptor, void *buffer, int numBytes)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, readFile(fileDescriptor, buffer, numBytes));
+}
+
+/*
+ * @brief	Writes a number of bytes from a buffer and into a file.
+ * @return	Number of bytes properly written, -1 in case of error.
+ */
+int ctx_writeFile(fs_ctx *ctx, int fileDescriptor, void *buffer, int numBytes)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, writeFile(fileDescriptor, buffer, numBytes));
+}
+
+/*
+ * @brief	Modifies the position of the seek pointer of a file.
+ * @return	0 if succes, -1 otherwise.
+ */
+int ctx_lseekFile(fs_ctx *ctx, int fileDescriptor, long offset, int whence)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, lseekFile(fileDescriptor, offset, whence));
+}
+
+/*
+ * @brief	Reads a number of bytes from a position of a file, without moving its seek pointer.
+ * @return	Number of bytes properly read, -1 in case of error.
+ */
+int ctx_preadFile(fs_ctx *ctx, int fileDescriptor, void *buffer, int numBytes, long offset)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, preadFile(fileDescriptor, buffer, numBytes, offset));
+}
+
+/*
+ * @brief	Writes a number of bytes into a position of a file, without moving its seek pointer.
+ * @return	Number of bytes properly written, -1 in case of error.
+ */
+int ctx_pwriteFile(fs_ctx *ctx, int fileDescriptor, void *buffer, int numBytes, long offset)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, pwriteFile(fileDescriptor, buffer, numBytes, offset));
+}
+
+/*
+ * @brief	Reads from a file into a list of buffers, filling each one before the next.
+ * @return	Number of bytes properly read, -1 in case of error.
+ */
+int ctx_readvFile(fs_ctx *ctx, int fileDescriptor, const struct iovec *iov, int iovcnt)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, readvFile(fileDescriptor, iov, iovcnt));
+}
+
+/*
+ * @brief	Writes into a file the contents of a list of buffers, one after the other.
+ * @return	Number of bytes properly written, -1 in case of error.
+ */
+int ctx_writevFile(fs_ctx *ctx, int fileDescriptor, const struct iovec *iov, int iovcnt)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, writevFile(fileDescriptor, iov, iovcnt));
+}
+
+/*
+ * @brief	Allocates the data blocks of a range of a file in advance, contiguously when possible. The size of the file does not change.
+ * @return	0 if success, -1 in case of error, -2 if the file system is not mounted.
+ */
+int ctx_fallocateFile(fs_ctx *ctx, int fileDescriptor, long offset, long length)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, fallocateFile(fileDescriptor, offset, length));
+}
+
+/*
+ * @brief	Checks the integrity of the file.
+ * @return	0 if success, -1 if the file is corrupted, -2 in case of error.
+ */
+int ctx_checkFile(fs_ctx *ctx, char *fileName)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, checkFile(fileName));
+}
+
+/*
+ * @brief	Checks the integrity of all the closed files that include it, several files at a time.
+ * @return	Number of corrupted files, -1 in case of error.
+ */
+int ctx_checkAllFiles(fs_ctx *ctx)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, checkAllFiles());
+}
+
+/*
+ * @brief	Include integrity on a file.
+ * @return	0 if success, -1 if the file does not exists, -2 in case of error.
+ */
+int ctx_includeIntegrity(fs_ctx *ctx, char *fileName)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, includeIntegrity(fileName));
+}
+
+/*
+ * @brief	Opens an existing file and checks its integrity
+ * @return	The file descriptor if possible, -1 if file does not exist, -2 if the file is corrupted, -3 in case of error
+ */
+int ctx_openFileIntegrity(fs_ctx *ctx, char *fileName)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, openFileIntegrity(fileName));
+}
+
+/*
+ * @brief	Closes a file and updates its integrity.
+ * @return	0 if success, -1 otherwise.
+ */
+int ctx_closeFileIntegrity(fs_ctx *ctx, int fileDescriptor)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, closeFileIntegrity(fileDescriptor));
+}
+
+/*
+ * @brief	Creates a new directory, provided its parent directory exists and the name is not in use.
+ * @return	0 if success, -1 if the name already exists, -2 in case of error.
+ */
+int ctx_mkDir(fs_ctx *ctx, char *path)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, mkDir(path));
+}
+
+/*
+ * @brief	Deletes an empty directory.
+ * @return	0 if success, -1 if the directory does not exist, -2 in case of error.
+ */
+int ctx_rmDir(fs_ctx *ctx, char *path)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, rmDir(path));
+}
+
+/*
+ * @brief	Creates a symbolic link to an existing file in the file system.
+ * @return	0 if success, -1 if file does not exist, -2 in case of error.
+ */
+int ctx_createLn(fs_ctx *ctx, char *fileName, char *linkName)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, createLn(fileName, linkName));
+}
+
+/*
+ * @brief	Deletes an existing symbolic link
+ * @return	0 if the file is correct, -1 if the symbolic link does not exist, -2 in case of error.
+ */
+int ctx_removeLn(fs_ctx *ctx, char *linkName)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, removeLn(linkName));
+}
+
+/*
+ * @brief	Creates a hard link, another name for an existing regular file.
+ * @return	0 if success, -1 if file does not exist, -2 in case of error.
+ */
+int ctx_createHardLn(fs_ctx *ctx, char *fileName, char *linkName)
+{
+    struct fs_ctx *prev = fs_bind(ctx);
+    return fs_unbind(prev, createHardLn(fileName, linkName));
+}
+
 /*
 * @brief        Writes metadata to disk
 * @return       0 if succes, -1 in case of error
 */
 int write_metadata() {
-    /* Write superblock to disk */
-    if (bwrite(DEVICE_IMAGE, 0, (char*) &(s_block)) == -1) {
-        perror("write_metadata: Error writing superblock to disk\n");
-        return -1;
-    }
+    /* Write superblock to disk, only if it changed */
     char buffer[BLOCK_SIZE];
+    if (fs->sblock_dirty == 1) {
+        pack_sblock(buffer);
+        if (bwrite(fs->device, 0, buffer) == -1) {
+            perror("write_metadata: Error writing superblock to disk\n");
+            return -1;
+        }
+        fs->sblock_dirty = 0;
+    }
     /* Write i_nodes to disk */
-    /* For each inode block we have to write 16 inodes */
-    for (int i = 0; i < s_block.n_blocks_inodes; i++) {
-        int buffer_offset = 0;
-        /* Fill a buffer with all the inodes that fit in a block and write it to the disk */
-        for (int j = 0; j < INODES_BLOCK; j++) {
-            memmove(buffer+buffer_offset, &(i_nodes[i*INODES_BLOCK+j]), sizeof(i_nodes[i*INODES_BLOCK+j]));
-            buffer_offset += sizeof(i_nodes[i*INODES_BLOCK+j]);
+    /* For each inode block that changed we have to write 16 inodes */
+    for (int i = 0; i < fs->s_block.n_blocks_inodes; i++) {
+        if (fs->iblock_dirty[i] == 0) {
+            continue;
         }
-	if (bwrite(DEVICE_IMAGE, 1+i, buffer) == -1) {
+        /* Fill a buffer with all the inodes that fit in a block and write it to the disk */
+        pack_inodes(i, buffer);
+	if (bwrite(fs->device, 1+i, buffer) == -1) {
 	    perror("write_metadata: Error writing inodes to disk\n");
             return -1;
         }
+        fs->iblock_dirty[i] = 0;
     }
     return 0;
 }
 
 /*
-* @brief        Reads metadata from disk
-* @return       0 if succes, -1 in case of error
+* @brief        Fills a buffer with the inodes of an inode block as they are stored in the disk
 */
-int read_metadata() {
-    /* Read superblock from disk */
-    if (bread(DEVICE_IMAGE, 0, (char*) &(s_block)) == -1) {
-        perror("read_metadata: Error reading superblock from disk\n");
-        return -1;
-    }
-    char buffer[BLOCK_SIZE];
-    /* Read inodes from disk, using a buffer as we did in the functon write_metadata() */
-    for (int i = 0; i < N_INODES/INODES_BLOCK; i++) {
-	if (bread(DEVICE_IMAGE, 1+i, buffer) == -1){
-            perror("read_metadata: Error reading inode from disk\n");
-            return -1;
+void pack_inodes(int inode_block, char *buffer) {
+    /* Inodes that are not in memory were not changed since they were last written, so they are taken from the disk */
+    if (bread(fs->device, 1+inode_block, buffer) == -1) {
+        perror("pack_inodes: Error reading inodes from disk\n");
+    }
+    for (int j = 0; j < INODES_BLOCK; j++) {
+        /* Each inode is copied while no thread is in the middle of changing it */
+        int inode_id = inode_block*INODES_BLOCK+j;
+        inode_rdlock(inode_id);
+        pthread_mutex_lock(&(fs->locks.icache));
+        struct icache_entry *entry = icache_find(inode_id);
+        struct Inode *inode = (struct Inode *) (buffer+j*sizeof(struct Inode));
+        if (entry != NULL) {
+            memmove(inode, &(entry->inode), sizeof(struct Inode));
         }
-        int buffer_offset = 0;
-        for (int j = 0; j < INODES_BLOCK; j++) {
-            memmove(&(i_nodes[i*INODES_BLOCK+j]), buffer+buffer_offset, sizeof(i_nodes[i*INODES_BLOCK+j]));
-            buffer_offset += sizeof(i_nodes[i*INODES_BLOCK+j]);
+        pthread_mutex_unlock(&(fs->locks.icache));
+        inode_unlock(inode_id, 0);
+        if (entry == NULL) {
+            continue;
         }
+        /* Delayed blocks only exist in memory, in the disk they are not allocated yet */
+        if (inode->direct_block == DELAYED_BLOCK) inode->direct_block = -1;
+        if (inode->indirect_block1 == DELAYED_BLOCK) inode->indirect_block1 = -1;
+        if (inode->indirect_block2 == DELAYED_BLOCK) inode->indirect_block2 = -1;
+        if (inode->indirect_block3 == DELAYED_BLOCK) inode->indirect_block3 = -1;
+        if (inode->indirect_block4 == DELAYED_BLOCK) inode->indirect_block4 = -1;
     }
-    return 0;
 }
 
 /*
-* @brief        Allocates new inode
-* @return       0 if succes, -1 in case there are no more free inodes
+* @brief        Logs the metadata blocks that changed as a transaction of the journal and then writes them to their place
+* @return       0 if succes, -1 in case of error
 */
-int ialloc() {
-    /* Look for a free inode using the map */
-    for (int i = 0; i < N_INODES; i++) {
-        if (bitmap_getbit(s_block.inode_map, i) == 0) {
-            /* Allocate the inode */
-            bitmap_setbit(s_block.inode_map, i, 1);
-            return i;
+int journal_commit() {
+    /* The transaction is made of a descriptor followed by a copy of each block that changed */
+    char log[(1+JOURNAL_MAX_BLOCKS)*BLOCK_SIZE];
+    JournalDescriptor *descriptor = (JournalDescriptor *) log;
+    memset(descriptor, 0, BLOCK_SIZE);
+    int n_blocks = 0;
+    /* Transactions are packed and logged one at a time, so that they reach the journal in the order their copies were taken.
+       The name index in the superblock only changes with the lock of the namespace, which is held while the copies are taken */
+    names_lock();
+    journal_lock();
+    /* Blocks are marked as unchanged before they are copied, so a change made meanwhile by another thread goes in the next transaction */
+    pthread_mutex_lock(&(fs->locks.alloc));
+    if (fs->sblock_dirty == 1) {
+        fs->sblock_dirty = 0;
+        descriptor->blocks[n_blocks] = 0;
+        pack_sblock(log+(1+n_blocks)*BLOCK_SIZE);
+        n_blocks++;
+    }
+    /* The blocks freed so far are free in the copy of the superblock, this transaction or an older one commits them */
+    int freed = fs->freed_total;
+    pthread_mutex_unlock(&(fs->locks.alloc));
+    for (int i = 0; i < fs->s_block.n_blocks_inodes; i++) {
+        pthread_mutex_lock(&(fs->locks.icache));
+        int dirty = fs->iblock_dirty[i];
+        fs->iblock_dirty[i] = 0;
+        fs->iblock_writing[i] += dirty;
+        pthread_mutex_unlock(&(fs->locks.icache));
+        if (dirty == 1) {
+            descriptor->blocks[n_blocks] = 1+i;
+            pack_inodes(i, log+(1+n_blocks)*BLOCK_SIZE);
+            n_blocks++;
         }
     }
-    perror("ialloc: There are no free inodes\n");
-    return -1;
+    names_unlock(0);
+    fs->pending_ops = 0;
+    if (n_blocks == 0) {
+        return journal_unlock(0);
+    }
+    /* When the transaction doesn't fit at the end of the journal we start again from the beginning */
+    if (fs->journal_head+n_blocks+2 > fs->s_block.n_journal_blocks) {
+        if (journal_empty() == -1) {
+            return journal_unlock(journal_redirty(descriptor->blocks, n_blocks));
+        }
+    }
+    descriptor->magic = JOURNAL_DESCRIPTOR;
+    descriptor->sequence = fs->journal_sequence;
+    descriptor->n_blocks = n_blocks;
+    JournalCommit commit;
+    memset(&commit, 0, sizeof(commit));
+    commit.magic = JOURNAL_COMMIT;
+    commit.sequence = fs->journal_sequence;
+    commit.checksum = CRC32((unsigned char *) log, (1+n_blocks)*BLOCK_SIZE);
+
+    /* Write the descriptor, the blocks and the commit block */
+    for (int i = 0; i <= n_blocks; i++) {
+        if (bwrite(fs->device, fs->s_block.journal_start+fs->journal_head+i, log+i*BLOCK_SIZE) == -1) {
+            perror("journal_commit: Error writing the journal\n");
+            return journal_unlock(journal_redirty(descriptor->blocks, n_blocks));
+        }
+    }
+    if (bwrite(fs->device, fs->s_block.journal_start+fs->journal_head+n_blocks+1, (char *) &commit) == -1) {
+        perror("journal_commit: Error writing the journal\n");
+        return journal_unlock(journal_redirty(descriptor->blocks, n_blocks));
+    }
+    int sequence = fs->journal_sequence;
+    fs->journal_head += n_blocks+2;
+    fs->journal_sequence++;
+    journal_unlock(0);
+
+    /* A single synchronization makes the whole group durable, if the commit block reaches the disk before the rest the checksum won't match.
+       It is done without the lock, so that other threads log their transactions meanwhile */
+    int failed = 0;
+    if (bsync(fs->device) == -1) {
+        perror("journal_commit: Error synchronizing the journal\n");
+        failed = 1;
+    }
+    /* Now that the transaction is safe the blocks can be written to their place, as they were logged.
+       Transactions do it in the order of their sequence numbers, so that an older copy of a block never overwrites a newer one */
+    journal_lock();
+    while (fs->journal_applied != sequence-1) {
+        pthread_cond_wait(&(fs->locks.journal_applied), &(fs->locks.journal));
+    }
+    for (int i = 1; failed == 0 && i <= n_blocks; i++) {
+        if (bwrite(fs->device, descriptor->blocks[i-1], log+i*BLOCK_SIZE) == -1) {
+            perror("journal_commit: Error writing metadata to disk\n");
+            failed = 1;
+        }
+    }
+    /* Blocks freed by the transaction can be allocated again now that it is committed */
+    if (failed == 0 && bfree_release(freed) == -1) {
+        failed = 1;
+    }
+    fs->journal_applied = sequence;
+    pthread_cond_broadcast(&(fs->locks.journal_applied));
+    journal_unlock(0);
+    if (failed == 1) {
+        return journal_redirty(descriptor->blocks, n_blocks);
+    }
+    /* The inodes that were kept in memory only because they had changed can go now, the next thread that releases the lock of the namespace drops them */
+    pthread_mutex_lock(&(fs->locks.icache));
+    for (int i = 0; i < n_blocks; i++) {
+        if (descriptor->blocks[i] != 0) {
+            fs->iblock_writing[descriptor->blocks[i]-1]--;
+        }
+    }
+    pthread_mutex_unlock(&(fs->locks.icache));
+    return 0;
 }
 
 
 /*
-* @brief        Allocates new data block
-* @return       0 if succes, -1 in case there are no more free data blocks
+* @brief        Marks again as changed the blocks of a transaction that couldn't be committed, so that the next one includes them
+* @return       -1, so that it can be used in a return
 */
-int balloc() {
-    /* Look for a free block using the map */
-    for (int i = 0; i < s_block.n_data_blocks; i++) {
-        if (bitmap_getbit(s_block.block_map, i) == 0) {
-            /* Allocate te block */
-            bitmap_setbit(s_block.block_map, i, 1);
-            return i;
+int journal_redirty(int *blocks, int n_blocks) {
+    for (int i = 0; i < n_blocks; i++) {
+        if (blocks[i] == 0) {
+            mark_sblock();
+            continue;
         }
+        pthread_mutex_lock(&(fs->locks.icache));
+        fs->iblock_dirty[blocks[i]-1] = 1;
+        fs->iblock_writing[blocks[i]-1]--;
+        pthread_mutex_unlock(&(fs->locks.icache));
     }
-    perror("alloc: There are no free blocks\n");
     return -1;
 }
 
 /*
-* @brief        Frees an inode
+* @brief        Counts an operation that changed metadata, committing the group of pending operations once it is complete
+* @return       0 if success, -1 if the group couldn't be committed
+*/
+int journal_op() {
+    journal_lock();
+    fs->pending_ops++;
+    int complete = fs->pending_ops >= JOURNAL_GROUP;
+    journal_unlock(0);
+    if (complete == 1 && journal_commit() == -1) {
+        perror("journal_op: Error committing metadata\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+* @brief        Empties the journal once the blocks logged in it are safe in their place
 * @return       0 if succes, -1 in case of error
 */
-int ifree(int inode_id) {
-    /* Check validity of argument */
-    if (inode_id < 0 || inode_id >= N_INODES) {
-        perror("ifree: Node id isn't valid\n");
+int journal_checkpoint() {
+    journal_lock();
+    return journal_unlock(journal_empty());
+}
+
+/*
+* @brief        Empties the journal once the blocks of all the transactions logged in it are in their place, with the lock of the journal taken
+* @return       0 if succes, -1 in case of error
+*/
+int journal_empty() {
+    /* Transactions logged by other threads are written to their place first, waiting releases the lock meanwhile */
+    while (fs->journal_applied != fs->journal_sequence-1) {
+        pthread_cond_wait(&(fs->locks.journal_applied), &(fs->locks.journal));
+    }
+    if (bsync(fs->device) == -1) {
+        perror("journal_checkpoint: Error synchronizing the device\n");
+        return -1;
+    }
+    /* The next transaction will be the first one after the header */
+    JournalHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = JOURNAL_MAGIC;
+    header.sequence = fs->journal_sequence;
+    if (bwrite(fs->device, fs->s_block.journal_start, (char *) &header) == -1) {
+        perror("journal_checkpoint: Error writing the journal header\n");
         return -1;
     }
-    /* Set the bit in the map as free */
-    bitmap_setbit(s_block.inode_map, inode_id, 0);
-    /* Delete its values from the metadata */
-    memset(&(i_nodes[inode_id]), 0, sizeof(i_nodes[inode_id]));
-    memset(&(inode_x[inode_id]), 0, sizeof(inode_x[inode_id]));
+    fs->journal_head = 1;
     return 0;
 }
 
 /*
-* @brief        Frees a data block
-* @return       0 if succes, -1 in case there are no more free data blocks
+* @brief        Writes to their place the blocks of all the complete transactions of the journal
+* @return       0 if succes, -1 in case of error
 */
-int bfree(int block_id) {
-    /* Check the validity of argument */
-    if (block_id < 0 || block_id >= s_block.n_data_blocks) {
-        perror("bfree: Block id isn't valid\n");
+int journal_replay() {
+    /* The location of the journal never changes, so it can be read from the superblock in the disk */
+    if (bread(fs->device, 0, (char*) &(fs->s_block)) == -1) {
+        perror("journal_replay: Error reading superblock from disk\n");
         return -1;
     }
-    /* Set the bit in the map as free */
-    bitmap_setbit(s_block.block_map, block_id, 0);
-    /* Delete contents of te block from the disk */
-    char buffer[BLOCK_SIZE];
-    memset(buffer, 0, sizeof(buffer));
-    if (bwrite(DEVICE_IMAGE, s_block.first_data_block+block_id, buffer) == -1) {
-        perror("bfree: Couldn't delete block data\n");
+    /* A device without a file system has no journal to look for */
+    if (fs->s_block.magic_number != MAGIC_NUM) {
+        perror("journal_replay: The device has no file system\n");
+        return -1;
+    }
+    JournalHeader header;
+    if (bread(fs->device, fs->s_block.journal_start, (char *) &header) == -1 || header.magic != JOURNAL_MAGIC) {
+        perror("journal_replay: Error reading the journal header\n");
+        return -1;
+    }
+    char log[(1+JOURNAL_MAX_BLOCKS)*BLOCK_SIZE];
+    JournalDescriptor *descriptor = (JournalDescriptor *) log;
+    JournalCommit commit;
+    fs->journal_sequence = header.sequence;
+    fs->journal_applied = header.sequence-1;
+    fs->journal_head = 1;
+    while (fs->journal_head+2 <= fs->s_block.n_journal_blocks) {
+        /* Transactions follow each other with consecutive sequence numbers, anything else is left from before the last checkpoint */
+        if (bread(fs->device, fs->s_block.journal_start+fs->journal_head, log) == -1) {
+            break;
+        }
+        int n_blocks = descriptor->n_blocks;
+        if (descriptor->magic != JOURNAL_DESCRIPTOR || descriptor->sequence != fs->journal_sequence || n_blocks < 1 || n_blocks > JOURNAL_MAX_BLOCKS || fs->journal_head+n_blocks+2 > fs->s_block.n_journal_blocks) {
+            break;
+        }
+        int complete = 1;
+        for (int i = 1; i <= n_blocks; i++) {
+            if (bread(fs->device, fs->s_block.journal_start+fs->journal_head+i, log+i*BLOCK_SIZE) == -1) {
+                complete = 0;
+            }
+        }
+        /* Only transactions whose commit block matches their contents are applied */
+        if (complete == 0 || bread(fs->device, fs->s_block.journal_start+fs->journal_head+n_blocks+1, (char *) &commit) == -1) {
+            break;
+        }
+        if (commit.magic != JOURNAL_COMMIT || commit.sequence != fs->journal_sequence || commit.checksum != CRC32((unsigned char *) log, (1+n_blocks)*BLOCK_SIZE)) {
+            break;
+        }
+        for (int i = 1; i <= n_blocks; i++) {
+            if (bwrite(fs->device, descriptor->blocks[i-1], log+i*BLOCK_SIZE) == -1) {
+                perror("journal_replay: Error writing logged block\n");
+                return -1;
+            }
+        }
+        fs->journal_head += n_blocks+2;
+        fs->journal_applied = fs->journal_sequence++;
+    }
+    /* Everything that was replayed is in its place, so the journal can be emptied */
+    return journal_checkpoint();
+}
+
+/*
+* @brief        Marks the superblock as changed, so that it is written in the next write_metadata()
+*/
+void mark_sblock() {
+    /* It is marked without taking any lock, so that allocating doesn't need one */
+    fs->sblock_dirty = 1;
+}
+
+/*
+* @brief        Marks the block of an inode as changed, so that it is written in the next write_metadata()
+*/
+void mark_inode(int inode_id) {
+    if (inode_id >= 0 && inode_id < N_INODES) {
+        pthread_mutex_lock(&(fs->locks.icache));
+        fs->iblock_dirty[inode_id/INODES_BLOCK] = 1;
+        hot_sync(inode_id);
+        pthread_mutex_unlock(&(fs->locks.icache));
+    }
+}
+
+/*
+* @brief        Copies the fields of an inode that changed to the hot arrays
+*/
+void hot_sync(int inode_id) {
+    struct Inode *inode = iget(inode_id);
+    fs->hot.type[inode_id] = inode->type;
+    fs->hot.target[inode_id] = inode->inode;
+    fs->hot.size[inode_id] = inode->size;
+}
+
+/*
+* @brief        Fills the hot arrays with the fields of the inodes of a block as it is stored in the disk
+*/
+void hot_fill(int inode_block, char *buffer) {
+    if (fs->hot_loaded[inode_block] == 1) {
+        return;
+    }
+    for (int j = 0; j < INODES_BLOCK; j++) {
+        struct Inode *inode = (struct Inode *) (buffer+j*sizeof(struct Inode));
+        fs->hot.type[inode_block*INODES_BLOCK+j] = inode->type;
+        fs->hot.target[inode_block*INODES_BLOCK+j] = inode->inode;
+        fs->hot.size[inode_block*INODES_BLOCK+j] = inode->size;
+    }
+    fs->hot_loaded[inode_block] = 1;
+}
+
+/*
+* @brief        Makes sure the hot fields of an inode are in memory, reading its inode block if they are not
+* @return       The index of the inode in the hot arrays
+*/
+int hot_get(int inode_id) {
+    int inode_block = inode_id/INODES_BLOCK;
+    pthread_mutex_lock(&(fs->locks.icache));
+    if (fs->hot_loaded[inode_block] == 0) {
+        char buffer[BLOCK_SIZE];
+        if (bread(fs->device, 1+inode_block, buffer) == -1) {
+            perror("hot_get: Error reading inodes from disk\n");
+        }
+        else {
+            hot_fill(inode_block, buffer);
+        }
+    }
+    pthread_mutex_unlock(&(fs->locks.icache));
+    return inode_id;
+}
+
+/*
+* @brief        Reads metadata from disk
+* @return       0 if succes, -1 in case of error
+*/
+int read_metadata() {
+    /* Read the superblock and the first inode blocks from disk with a single request */
+    int n_eager = N_INODES/INODES_BLOCK < INODE_EAGER_BLOCKS ? N_INODES/INODES_BLOCK : INODE_EAGER_BLOCKS;
+    char eager[INODE_EAGER_BLOCKS*BLOCK_SIZE];
+    struct iovec iov[2];
+    iov[0].iov_base = &(fs->s_block);
+    iov[0].iov_len = BLOCK_SIZE;
+    iov[1].iov_base = eager;
+    iov[1].iov_len = n_eager*BLOCK_SIZE;
+    if (breadv(fs->device, 0, iov, 2) == -1) {
+        perror("read_metadata: Error reading metadata from disk\n");
         return -1;
     }
+    /* The first inodes go to the cache as long as they fit, the rest are read the first time they are used */
+    icache_clear();
+    memset(fs->hot_loaded, 0, sizeof(fs->hot_loaded));
+    for (int i = 0; i < n_eager; i++) {
+        hot_fill(i, eager+i*BLOCK_SIZE);
+    }
+    for (int i = 0; i < n_eager*INODES_BLOCK && i < INODE_CACHE_SIZE; i++) {
+        icache_load(i, eager+i*sizeof(struct Inode));
+    }
+    /* What is in memory is what is on the disk */
+    fs->sblock_dirty = 0;
+    memset(fs->iblock_dirty, 0, sizeof(fs->iblock_dirty));
+    /* Load the maps into words and count the free data blocks, nothing is reserved when the file system is mounted */
+    memset(fs->block_words, 0, sizeof(fs->block_words));
+    memset(fs->inode_words, 0, sizeof(fs->inode_words));
+    fs->avail_blocks = 0;
+    fs->freed_total = 0;
+    fs->released_total = 0;
+    for (int i = 0; i < fs->s_block.n_data_blocks; i++) {
+        if (bitmap_getbit(fs->s_block.block_map, i) != 0) {
+            bitmap_setbit_atomic(fs->block_words, i, 1);
+        }
+        else {
+            fs->avail_blocks++;
+        }
+    }
+    for (int i = 0; i < N_INODES; i++) {
+        if (bitmap_getbit(fs->s_block.inode_map, i) != 0) {
+            bitmap_setbit_atomic(fs->inode_words, i, 1);
+        }
+    }
+    /* Names cached in a previous session may not be valid for this device, the filter is built from the inodes in use */
+    dcache_clear();
+    bloom_rebuild();
     return 0;
 }
 
 /*
-* @brief        Looks for a file given its name
-* @return       The id of the inode, -1 if the file doesn't exist
+* @brief        Gets an inode, reading it from disk if it is not in the inode cache
+* @return       A pointer to the inode in memory, NULL if it can't be read from the disk. Inodes are only dropped from memory by the thread
+*               that holds the lock of the namespace, so the pointer is valid while the inode is held with ihold() or open, or while the
+*               caller holds that lock and loads less than INODE_CACHE_SIZE other inodes
 */
-int namei(char *fname) {
-    /* Look for the name of the file in the metadata */
-    for (int i=0; i < N_INODES; i++) {
-        if (strcmp(i_nodes[i].name, fname) == 0) {
-            return i;
+struct Inode *iget(int inode_id) {
+    pthread_mutex_lock(&(fs->locks.icache));
+    struct icache_entry *entry = icache_find(inode_id);
+    if (entry == NULL) {
+        /* If the inode can't be read nothing is cached, so that the next time it is read again */
+        char buffer[BLOCK_SIZE];
+        if (bread(fs->device, 1+inode_id/INODES_BLOCK, buffer) == -1) {
+            perror("iget: Error reading inode from disk\n");
+            pthread_mutex_unlock(&(fs->locks.icache));
+            return NULL;
+        }
+        /* Inodes in memory have their hot fields in memory too, so that hot_sync() keeps them up to date */
+        hot_fill(inode_id/INODES_BLOCK, buffer);
+        entry = icache_load(inode_id, buffer+(inode_id%INODES_BLOCK)*sizeof(struct Inode));
+        if (entry == NULL) {
+            pthread_mutex_unlock(&(fs->locks.icache));
+            return NULL;
+        }
+    }
+    /* Move it to the front of the LRU list */
+    if (entry != fs->lru_head) {
+        lru_unlink(entry);
+        lru_push(entry);
+    }
+    pthread_mutex_unlock(&(fs->locks.icache));
+    return &(entry->inode);
+}
+
+/*
+* @brief        Keeps an inode in the cache while a file uses it
+* @return       A pointer to the inode in memory, NULL if it can't be read from the disk
+*/
+struct Inode *ihold(int inode_id) {
+    pthread_mutex_lock(&(fs->locks.icache));
+    struct Inode *inode = iget(inode_id);
+    if (inode != NULL) {
+        icache_find(inode_id)->refcount++;
+    }
+    pthread_mutex_unlock(&(fs->locks.icache));
+    return inode;
+}
+
+/*
+* @brief        Releases an inode held with ihold(), if the cache is over its budget it is dropped once the lock of the namespace is released
+*/
+void iput(int inode_id) {
+    pthread_mutex_lock(&(fs->locks.icache));
+    struct icache_entry *entry = icache_find(inode_id);
+    if (entry != NULL && entry->refcount > 0) {
+        entry->refcount--;
+    }
+    pthread_mutex_unlock(&(fs->locks.icache));
+}
+
+/*
+* @brief        Drops the inodes the cache has over its budget that are not held or changed, with the lock of the namespace taken
+*/
+void icache_trim() {
+    pthread_mutex_lock(&(fs->locks.icache));
+    struct icache_entry *entry;
+    while (fs->icache_count > INODE_CACHE_SIZE && (entry = icache_victim()) != NULL) {
+        free(entry);
+        fs->icache_count--;
+    }
+    pthread_mutex_unlock(&(fs->locks.icache));
+}
+
+/*
+* @brief        Looks for an inode in the inode cache
+* @return       The entry of the inode, NULL if it is not in memory
+*/
+struct icache_entry *icache_find(int inode_id) {
+    for (struct icache_entry *entry = fs->icache_hash[inode_id%ICACHE_BUCKETS]; entry != NULL; entry = entry->hash_next) {
+        if (entry->inode_id == inode_id) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/*
+* @brief        Puts in the inode cache an inode as it is stored in the disk, making room for it if needed
+* @return       The entry of the inode, NULL if there is no memory for it
+*/
+struct icache_entry *icache_load(int inode_id, char *disk_inode) {
+    struct icache_entry *entry = NULL;
+    /* Threads without the lock of the namespace don't drop inodes, another thread may be using them */
+    if (fs->icache_count >= INODE_CACHE_SIZE && names_held > 0) {
+        entry = icache_victim();
+    }
+    /* While there is room, or when everything in memory is open, a new entry is allocated */
+    if (entry == NULL) {
+        entry = malloc(sizeof(struct icache_entry));
+        if (entry == NULL) {
+            perror("icache_load: Couldn't allocate memory for the inode\n");
+            return NULL;
+        }
+        fs->icache_count++;
+    }
+    memmove(&(entry->inode), disk_inode, sizeof(struct Inode));
+    entry->inode_id = inode_id;
+    entry->refcount = 0;
+    entry->hash_next = fs->icache_hash[inode_id%ICACHE_BUCKETS];
+    fs->icache_hash[inode_id%ICACHE_BUCKETS] = entry;
+    lru_push(entry);
+    return entry;
+}
+
+/*
+* @brief        Takes out of the inode cache the least recently used inode that is not open
+* @return       The entry taken out, NULL if all the inodes in memory are open or changed
+*/
+struct icache_entry *icache_victim() {
+    /* Unchanged inodes are dropped first, the disk already has them */
+    struct icache_entry *entry = fs->lru_tail;
+    while (entry != NULL && (entry->refcount != 0 || iblock_busy(entry->inode_id/INODES_BLOCK) == 1)) {
+        entry = entry->lru_prev;
+    }
+    /* Changed inodes stay until the journal commits them, which can't be done with the lock of the cache taken */
+    if (entry == NULL) {
+        return NULL;
+    }
+    icache_unhash(entry);
+    lru_unlink(entry);
+    return entry;
+}
+
+/*
+* @brief        Checks whether the disk may not have the inodes of an inode block as they are in memory, because they changed or are being committed
+* @return       1 if the inodes of the block have to stay in memory, 0 otherwise
+*/
+int iblock_busy(int inode_block) {
+    return fs->iblock_dirty[inode_block] == 1 || fs->iblock_writing[inode_block] > 0;
+}
+
+/*
+* @brief        Removes an entry from its bucket of the inode cache
+*/
+void icache_unhash(struct icache_entry *entry) {
+    struct icache_entry **link = &(fs->icache_hash[entry->inode_id%ICACHE_BUCKETS]);
+    while (*link != entry) {
+        link = &((*link)->hash_next);
+    }
+    *link = entry->hash_next;
+}
+
+/*
+* @brief        Empties the inode cache
+*/
+void icache_clear() {
+    pthread_mutex_lock(&(fs->locks.icache));
+    while (fs->lru_head != NULL) {
+        struct icache_entry *entry = fs->lru_head;
+        fs->lru_head = entry->lru_next;
+        free(entry);
+    }
+    fs->lru_tail = NULL;
+    memset(fs->icache_hash, 0, sizeof(fs->icache_hash));
+    fs->icache_count = 0;
+    pthread_mutex_unlock(&(fs->locks.icache));
+}
+
+/*
+* @brief        Puts an entry of the inode cache at the front of the LRU list
+*/
+void lru_push(struct icache_entry *entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = fs->lru_head;
+    if (fs->lru_head != NULL) {
+        fs->lru_head->lru_prev = entry;
+    }
+    else {
+        fs->lru_tail = entry;
+    }
+    fs->lru_head = entry;
+}
+
+/*
+* @brief        Takes an entry of the inode cache out of the LRU list
+*/
+void lru_unlink(struct icache_entry *entry) {
+    if (entry->lru_prev != NULL) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    }
+    else {
+        fs->lru_head = entry->lru_next;
+    }
+    if (entry->lru_next != NULL) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    }
+    else {
+        fs->lru_tail = entry->lru_prev;
+    }
+}
+/*
+* @brief        Allocates new inode
+* @return       0 if succes, -1 in case there are no more free inodes
+*/
+int ialloc() {
+    /* Inodes are only allocated with the name lock taken, so they are claimed straight from the map */
+    int inode_id = map_claim(fs->inode_words, N_INODES);
+    if (inode_id == -1) {
+        perror("ialloc: There are no free inodes\n");
+        return -1;
+    }
+    /* It was written to the disk as free until now */
+    mark_sblock();
+    return inode_id;
+}
+
+
+/*
+* @brief        Allocates a data block from the allocation cache of the calling thread, filling it from the map when it is empty
+* @return       The id of the block, -1 in case the cache can't be filled
+*/
+int balloc() {
+    struct alloc_cache *cache = cache_get();
+    pthread_mutex_lock(&(cache->lock));
+    /* Only when the cache runs out the map is used, claiming several blocks at once */
+    if (cache->n_blocks == 0 && cache_fill_blocks(cache) == 0) {
+        pthread_mutex_unlock(&(cache->lock));
+        return -1;
+    }
+    cache->n_blocks--;
+    int block_id = cache->blocks[cache->n_blocks];
+    pthread_mutex_unlock(&(cache->lock));
+    /* It was written to the disk as free until now */
+    mark_sblock();
+    return block_id;
+}
+
+/*
+* @brief        Allocates a run of contiguous data blocks, out of blocks already reserved by the caller
+* @return       The id of the first block of the run, -1 in case there is no run of free blocks that long
+*/
+int balloc_run(int n_blocks) {
+    if (n_blocks <= 0) {
+        return -1;
+    }
+    /* Look for the first sequence of n_blocks free blocks in the map */
+    int length = 0;
+    for (int i = 0; i < fs->s_block.n_data_blocks; i++) {
+        if (bitmap_getbit_atomic(fs->block_words, i) != 0) {
+            length = 0;
+            continue;
+        }
+        length++;
+        if (length < n_blocks) {
+            continue;
+        }
+        /* Claim all the blocks of the run, if another thread claimed one of them meanwhile give back the rest and keep looking after it */
+        int first = i-n_blocks+1, j;
+        for (j = first; j <= i && bitmap_setbit_atomic(fs->block_words, j, 1) == 0; j++);
+        if (j > i) {
+            mark_sblock();
+            return first;
+        }
+        for (int k = first; k < j; k++) {
+            bitmap_setbit_atomic(fs->block_words, k, 0);
         }
+        i = j;
+        length = 0;
     }
     return -1;
 }
 
 /*
-* @brief        Translates the offset of an inode to a block address
-* @return       The address of the block containing the offset, -1 in case of error
+* @brief        Reserves space for a logical block of an inode, keeping its data in memory until it is flushed
+* @return       DELAYED_BLOCK if success, -1 in case there are no more free data blocks
 */
-int bmap(int inode_id, int offset) {
-    /* Check the validity of the arguments */
+int reserve_block(int inode_id, int logic_block) {
+    /* Check validity of arguments */
     if (inode_id < 0 || inode_id >= N_INODES) {
-        perror("bmap: Node id is not valid\n");
+        perror("reserve_block: Node id isn't valid\n");
         return -1;
     }
-    /* Compute the block number of the offset in the file */
-    int logic_block;
-    logic_block = offset/BLOCK_SIZE;
-    
-    /* Return its corresponding address in the block map */
-    if (logic_block == 0) {
-        return i_nodes[inode_id].direct_block;
+    if (logic_block < 0 || logic_block >= MAX_FILE_SIZE/BLOCK_SIZE) {
+        perror("reserve_block: Logical block isn't valid\n");
+        return -1;
     }
-    else if (logic_block == 1) {
-        return i_nodes[inode_id].indirect_block1;
+    /* The data of the block starts zeroed, as a free block of the disk would */
+    char *data = calloc(1, BLOCK_SIZE);
+    if (data == NULL) {
+        perror("reserve_block: Couldn't allocate memory for the block\n");
+        return -1;
     }
-    else if (logic_block == 2) {
-        return i_nodes[inode_id].indirect_block2;
+    if (avail_take(1) == -1) {
+        cache_reclaim();
+        if (avail_take(1) == -1) {
+            free(data);
+            perror("reserve_block: There are no free blocks\n");
+            return -1;
+        }
     }
-    else if (logic_block == 3) {
-        return i_nodes[inode_id].indirect_block3;
+    fs->inode_x[inode_id].delayed[logic_block] = data;
+    set_block(inode_id, logic_block, DELAYED_BLOCK);
+    return DELAYED_BLOCK;
+}
+
+/*
+* @brief        Gives a physical block to all the delayed blocks of an inode and writes their data, placing them contiguously when possible
+* @return       0 if success, -1 in case of error
+*/
+int flush_delayed(int inode_id) {
+    /* Count the blocks of the file that are still in memory */
+    int n_delayed = 0;
+    for (int i = 0; i < MAX_FILE_SIZE/BLOCK_SIZE; i++) {
+        if (fs->inode_x[inode_id].delayed[i] != NULL) {
+            n_delayed++;
+        }
     }
-    else if (logic_block == 4) {
-        return i_nodes[inode_id].indirect_block4;
+    if (n_delayed == 0) {
+        return 0;
     }
-    perror("bmap: Offset is not valid\n");
-    return -1;
+    seq_write_begin(inode_id);
+    /* The blocks were reserved, so now they can be allocated */
+    int run = balloc_run(n_delayed);
+    for (int i = 0; i < MAX_FILE_SIZE/BLOCK_SIZE; i++) {
+        if (fs->inode_x[inode_id].delayed[i] == NULL) {
+            continue;
+        }
+        /* If there is no run long enough for the whole file each block goes to the first free block */
+        int block_id;
+        if (run != -1) {
+            block_id = run++;
+            set_block(inode_id, i, block_id);
+        }
+        else {
+            block_id = balloc_reserved(inode_id, i);
+            if (block_id == -1) {
+                cache_release();
+                return seq_write_end(inode_id, -1);
+            }
+        }
+        if (bwrite(fs->device, fs->s_block.first_data_block+block_id, fs->inode_x[inode_id].delayed[i]) == -1) {
+            perror("flush_delayed: Couldn't write block data\n");
+            cache_release();
+            return seq_write_end(inode_id, -1);
+        }
+        free(fs->inode_x[inode_id].delayed[i]);
+        fs->inode_x[inode_id].delayed[i] = NULL;
+    }
+    /* The blocks the thread cached and didn't use are left for the rest */
+    cache_release();
+    bmap_invalidate(inode_id);
+    return seq_write_end(inode_id, 0);
 }
 
 /*
-* @brief        Allocates an indirect block to an inode
-* @return       The id of the allocated block, -1 in case of error
+* @brief        Drops the delayed blocks of an inode without writing them, releasing their reservation
 */
-int add_data_block(int inode_id) {
-    /* Check the validity of argument */
+void discard_delayed(int inode_id) {
+    for (int i = 0; i < MAX_FILE_SIZE/BLOCK_SIZE; i++) {
+        if (fs->inode_x[inode_id].delayed[i] != NULL) {
+            free(fs->inode_x[inode_id].delayed[i]);
+            fs->inode_x[inode_id].delayed[i] = NULL;
+            set_block(inode_id, i, -1);
+            atomic_fetch_add(&(fs->avail_blocks), 1);
+        }
+    }
+}
+
+/*
+* @brief        Gives back to the map an inode just allocated that couldn't be used, nothing refers to it yet
+*/
+void ialloc_undo(int inode_id) {
+    bitmap_setbit_atomic(fs->inode_words, inode_id, 0);
+}
+
+/*
+* @brief        Frees an inode
+* @return       0 if succes, -1 in case of error
+*/
+int ifree(int inode_id) {
+    /* Check validity of argument */
     if (inode_id < 0 || inode_id >= N_INODES) {
-        perror("add_data_block: Node id isn't valid\n");
+        perror("ifree: Node id isn't valid\n");
         return -1;
     }
-    /* Compute which indirect block the new allocation corresponds to and allocate the block */
-    int block_id = balloc();
-    if (block_id == -1) {
+    /* Nothing changes if the inode can't be read */
+    struct Inode *inode = ihold(inode_id);
+    if (inode == NULL) {
         return -1;
     }
-    int logic_block = i_nodes[inode_id].size/BLOCK_SIZE;
-    if (logic_block == 1) {
-        i_nodes[inode_id].indirect_block1 = block_id;
-        return block_id;
+    /* Its name does not resolve to it anymore, unless it was already removed, and if it is a link its target doesn't have it */
+    if (inode->name[0] != '\0') {
+        name_unlink(inode_id);
     }
-    else if (logic_block == 2) {
-        i_nodes[inode_id].indirect_block2 = block_id;
-        return block_id;
+    if (fs->hot.type[hot_get(inode_id)] == SYM_LINK) {
+        link_remove(inode_id, fs->hot.target[inode_id]);
     }
-    else if (logic_block == 3) {
-        i_nodes[inode_id].indirect_block3 = block_id;
-        return block_id;
+    /* Descriptors still open on it don't refer to anything anymore */
+    for (int fd = 0; fs->inode_x[inode_id].opens > 0 && fd < MAX_OPEN_FILES; fd++) {
+        if (fs->file_table[fd].inode == inode_id) {
+            fd_free(fd);
+        }
     }
-    else if (logic_block == 4) {
-        i_nodes[inode_id].indirect_block4 = block_id;
-        return block_id;
+    /* Delete its values from the metadata, nobody has it open anymore */
+    memset(inode, 0, sizeof(struct Inode));
+    mark_inode(inode_id);
+    memset(&(fs->inode_x[inode_id]), 0, sizeof(fs->inode_x[inode_id]));
+    iput(inode_id);
+    /* Set the bit in the map as free once nothing refers to it */
+    bitmap_setbit_atomic(fs->inode_words, inode_id, 0);
+    mark_sblock();
+    return 0;
+}
+
+/*
+* @brief        Frees a data block
+* @return       0 if succes, -1 in case there are no more free data blocks
+*/
+int bfree(int block_id) {
+    /* Check the validity of argument */
+    if (block_id < 0 || block_id >= fs->s_block.n_data_blocks) {
+        perror("bfree: Block id isn't valid\n");
+        return -1;
     }
-    perror("add_data_block: Did not add indirect block");
-    return -1;
+    /* The block keeps its bit and its contents until the transaction that frees it is committed, if the system stops before
+       that the file still has it as it was */
+    pthread_mutex_lock(&(fs->locks.alloc));
+    fs->freed[fs->freed_total % MAX_DATA_BLOCKS] = block_id;
+    fs->freed_total++;
+    pthread_mutex_unlock(&(fs->locks.alloc));
+    mark_sblock();
+    return 0;
 }
 
 /*
-* @brief        Removes all existing links to the file represented by inode_id
-* @return       0 if success, -1 in case of error
+* @brief        Gives back to the map the blocks freed up to a point, once the transaction that frees them is committed
+* @return       0 if succes, -1 in case a block couldn't be deleted
 */
-int remove_links(int inode_id) {
-    for (int i=0; i < N_INODES; i++) {
-    /* If an allocated inode is a symbolic link and points to the file passed as argument we remove the symbolic link */
-        if (bitmap_getbit(s_block.inode_map, i) == 1 && i_nodes[i].type == SYM_LINK && i_nodes[i].inode == inode_id) {
-            if (removeLn(i_nodes[i].name) == -1) {
-	        return -1;
-	    }
-        }			
+int bfree_release(int freed) {
+    /* Delete contents of the blocks from the disk, before another thread can allocate them */
+    char buffer[BLOCK_SIZE];
+    memset(buffer, 0, sizeof(buffer));
+    pthread_mutex_lock(&(fs->locks.alloc));
+    while (fs->released_total < freed) {
+        int block_id = fs->freed[fs->released_total % MAX_DATA_BLOCKS];
+        if (bwrite(fs->device, fs->s_block.first_data_block+block_id, buffer) == -1) {
+            perror("bfree_release: Couldn't delete block data\n");
+            pthread_mutex_unlock(&(fs->locks.alloc));
+            return -1;
+        }
+        /* Set the bit in the map as free, it is counted once it can be claimed */
+        bitmap_setbit_atomic(fs->block_words, block_id, 0);
+        atomic_fetch_add(&(fs->avail_blocks), 1);
+        fs->released_total++;
     }
+    pthread_mutex_unlock(&(fs->locks.alloc));
     return 0;
 }
+
+/*
+* @brief        Looks for a file given its path
+* @return       The id of the inode, -1 if the file doesn't exist
+*/
+int namei(char *fname) {
+    /* Hard links are just other names of the file, so they resolve to it */
+    int inode_id = namei_entry(fname);
+    if (inode_id >= 0 && fs->hot.type[hot_get(inode_id)] == HARD_LINK) {
+        return fs->hot.target[inode_id];
+    }
+    return inode_id;
+}
+
+/*
+* @brief        Finds the entry of a path, without following hard links
+* @return       The id of the inode holding the name, -1 if it doesn't exist or the path isn't valid
+*/
+int namei_entry(char *fname) {
+    /* Resolve the directory containing the file and then the file itself inside it */
+    char name[NAME_LENGTH];
+    int parent = namei_parent(fname, name);
+    if (parent == -1) {
+        return -1;
+    }
+    return lookup(parent, name);
+}
+
+/*
+* @brief        Resolves the directory containing the last component of a path and copies that component into name
+* @return       The id of the directory inode (ROOT_INODE for the root directory), -1 if it doesn't exist or the path isn't valid
+*/
+int namei_parent(char *path, char *name) {
+    /* Only absolute paths are accepted */
+    if (path == NULL || path[0] != '/') {
+        return -1;
+    }
+    int dir = ROOT_INODE;
+    char *component = path;
+    while (1) {
+        /* Skip the separators before the next component */
+        while (*component == '/') {
+            component++;
+        }
+        int length = strcspn(component, "/");
+        if (length == 0 || length >= NAME_LENGTH) {
+            return -1;
+        }
+        /* If this is the last component the directory we are in is its parent */
+        char *next = component+length;
+        while (*next == '/') {
+            next++;
+        }
+        memcpy(name, component, length);
+        name[length] = '\0';
+        if (*next == '\0') {
+            return dir;
+        }
+        /* Otherwise the component has to be a directory */
+        dir = lookup(dir, name);
+        if (dir == -1 || fs->hot.type[hot_get(dir)] != DIRECTORY) {
+            return -1;
+        }
+        component = next;
+    }
+}
+
+/*
+* @brief        Looks for an entry in a directory, first in the directory entry cache and then in the inode table
+* @return       The id of the inode, -1 if the entry doesn't exist
+*/
+int lookup(int parent, char *name) {
+    unsigned int hash = name_hash(parent, name);
+    struct dentry *entry = &(fs->dcache[hash % DCACHE_SIZE]);
+    if (entry->inode != -1 && entry->parent == parent && strcmp(entry->name, name) == 0) {
+        return entry->inode;
+    }
+    /* If the filter doesn't know the name it doesn't exist, no need to look for it */
+    if (bloom_test(hash) == 0) {
+        return -1;
+    }
+    /* Look for the name in its bucket of the name index, only inodes with the same hash have to be compared, and remember it for next time */
+    for (int i = fs->s_block.index_head[hash % INDEX_BUCKETS]; i != -1; i = fs->s_block.index_next[i]) {
+        if (fs->s_block.index_hash[i] != hash) {
+            continue;
+        }
+        struct Inode *inode = iget(i);
+        if (inode != NULL && inode->parent == parent && strcmp(inode->name, name) == 0) {
+            dcache_insert(parent, name, i);
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+* @brief        Adds an inode to its parent directory, once its name and parent are set
+*/
+void name_link(int inode_id) {
+    int parent = iget(inode_id)->parent;
+    unsigned int hash = name_hash(parent, iget(inode_id)->name);
+    /* Insert it at the head of its bucket of the name index */
+    fs->s_block.index_hash[inode_id] = hash;
+    fs->s_block.index_next[inode_id] = fs->s_block.index_head[hash % INDEX_BUCKETS];
+    fs->s_block.index_head[hash % INDEX_BUCKETS] = inode_id;
+    mark_sblock();
+    mark_inode(inode_id);
+    if (parent != ROOT_INODE) {
+        iget(parent)->size++;
+        mark_inode(parent);
+    }
+    bloom_add(hash);
+    dcache_insert(parent, iget(inode_id)->name, inode_id);
+}
+
+/*
+* @brief        Removes an inode from its parent directory
+*/
+void name_unlink(int inode_id) {
+    int parent = iget(inode_id)->parent;
+    unsigned int hash = fs->s_block.index_hash[inode_id];
+    /* Unchain it from its bucket of the name index */
+    int *link = &(fs->s_block.index_head[hash % INDEX_BUCKETS]);
+    while (*link != -1 && *link != inode_id) {
+        link = &(fs->s_block.index_next[*link]);
+    }
+    if (*link == inode_id) {
+        *link = fs->s_block.index_next[inode_id];
+    }
+    fs->s_block.index_next[inode_id] = -1;
+    mark_sblock();
+    if (parent != ROOT_INODE) {
+        iget(parent)->size--;
+        mark_inode(parent);
+    }
+    bloom_remove(hash);
+    dcache_remove(parent, iget(inode_id)->name);
+}
+
+/*
+* @brief        Computes the hash of a name inside a directory
+* @return       The hash value
+*/
+unsigned int name_hash(int parent, char *name) {
+    /* FNV-1a over the id of the directory and the name */
+    unsigned int hash = 2166136261u ^ (unsigned int) parent;
+    hash *= 16777619u;
+    for (int i = 0; name[i] != '\0'; i++) {
+        hash ^= (unsigned char) name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/*
+* @brief        Computes the counter of the filter of existing names used by the i-th hash of a name
+* @return       The position of the counter
+*/
+int bloom_position(unsigned int hash, int i) {
+    /* Double hashing, the second hash is taken from the high bits and forced to be odd */
+    unsigned int step = (hash >> 16) | 1;
+    return (hash + i*step) % BLOOM_SIZE;
+}
+
+/*
+* @brief        Adds a name, given its hash, to the filter of existing names
+*/
+void bloom_add(unsigned int hash) {
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        /* Saturated counters stay saturated, as we don't know anymore how many names use them */
+        if (fs->bloom[bloom_position(hash, i)] < 255) {
+            fs->bloom[bloom_position(hash, i)]++;
+        }
+    }
+}
+
+/*
+* @brief        Removes a name, given its hash, from the filter of existing names
+*/
+void bloom_remove(unsigned int hash) {
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        if (fs->bloom[bloom_position(hash, i)] > 0 && fs->bloom[bloom_position(hash, i)] < 255) {
+            fs->bloom[bloom_position(hash, i)]--;
+        }
+    }
+}
+
+/*
+* @brief        Checks if a name, given its hash, may exist
+* @return       0 if the name doesn't exist for sure, 1 if it may exist
+*/
+int bloom_test(unsigned int hash) {
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        if (fs->bloom[bloom_position(hash, i)] == 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+* @brief        Builds the filter of existing names from the hashes stored in the name index
+*/
+void bloom_rebuild() {
+    memset(fs->bloom, 0, sizeof(fs->bloom));
+    for (int i = 0; i < N_INODES; i++) {
+        if (bitmap_getbit_atomic(fs->inode_words, i) != 0) {
+            bloom_add(fs->s_block.index_hash[i]);
+        }
+    }
+}
+
+/*
+* @brief        Stores in the directory entry cache the inode a name resolves to, replacing whatever was in its slot
+*/
+void dcache_insert(int parent, char *name, int inode_id) {
+    struct dentry *entry = &(fs->dcache[name_hash(parent, name) % DCACHE_SIZE]);
+    entry->parent = parent;
+    strcpy(entry->name, name);
+    entry->inode = inode_id;
+}
+
+/*
+* @brief        Removes a name from the directory entry cache
+*/
+void dcache_remove(int parent, char *name) {
+    struct dentry *entry = &(fs->dcache[name_hash(parent, name) % DCACHE_SIZE]);
+    if (entry->inode != -1 && entry->parent == parent && strcmp(entry->name, name) == 0) {
+        entry->inode = -1;
+    }
+}
+
+/*
+* @brief        Empties the directory entry cache
+*/
+void dcache_clear() {
+    for (int i = 0; i < DCACHE_SIZE; i++) {
+        fs->dcache[i].inode = -1;
+    }
+}
+
+/*
+* @brief        Translates the offset of an inode to a block address
+* @return       The address of the block containing the offset, -1 in case of error
+*/
+int bmap(int inode_id, int offset) {
+    /* Check the validity of the arguments */
+    if (inode_id < 0 || inode_id >= N_INODES) {
+        perror("bmap: Node id is not valid\n");
+        return -1;
+    }
+    /* Compute the block number of the offset in the file */
+    int logic_block;
+    logic_block = offset/BLOCK_SIZE;
+    
+    /* Return its corresponding address in the block map */
+    if (logic_block == 0) {
+        return iget(inode_id)->direct_block;
+    }
+    else if (logic_block == 1) {
+        return iget(inode_id)->indirect_block1;
+    }
+    else if (logic_block == 2) {
+        return iget(inode_id)->indirect_block2;
+    }
+    else if (logic_block == 3) {
+        return iget(inode_id)->indirect_block3;
+    }
+    else if (logic_block == 4) {
+        return iget(inode_id)->indirect_block4;
+    }
+    perror("bmap: Offset is not valid\n");
+    return -1;
+}
+
+/*
+* @brief        Translates the offset of an inode to a block address, reusing the last run translated for its descriptor
+* @return       The address of the block containing the offset, -1 in case of error
+*/
+int bmap_cache(struct open_file *file, int offset) {
+    int inode_id = file->inode;
+    int logic_block = offset/BLOCK_SIZE;
+
+    /* If the block falls inside the run cached by the descriptor, and the blocks of the file didn't change since then, we don't need to translate it again */
+    int run_offset = logic_block - file->map_logical;
+    if (file->map_version == fs->inode_x[inode_id].map_version && run_offset >= 0 && run_offset < file->map_length) {
+        return file->map_physical + run_offset;
+    }
+    /* Blocks that are not on the disk yet cannot be part of a run */
+    int block_id = bmap(inode_id, offset);
+    if (block_id < 0) {
+        return block_id;
+    }
+    /* Extend the run over the following blocks of the file as long as they are physically contiguous */
+    int length = 1;
+    while (logic_block+length < MAX_FILE_SIZE/BLOCK_SIZE && bmap(inode_id, (logic_block+length)*BLOCK_SIZE) == block_id+length) {
+        length++;
+    }
+    file->map_logical = logic_block;
+    file->map_physical = block_id;
+    file->map_length = length;
+    file->map_version = fs->inode_x[inode_id].map_version;
+    return block_id;
+}
+
+/*
+* @brief        Discards the runs cached by bmap_cache for an inode in all its descriptors, must be called whenever its blocks change
+*/
+void bmap_invalidate(int inode_id) {
+    fs->inode_x[inode_id].map_version++;
+}
+
+/*
+* @brief        Sets the block pointer of an inode that holds a logical block of the file
+*/
+void set_block(int inode_id, int logic_block, int block_id) {
+    /* The cached translation of the inode may not be valid anymore */
+    bmap_invalidate(inode_id);
+    mark_inode(inode_id);
+    if (logic_block == 0) {
+        iget(inode_id)->direct_block = block_id;
+    }
+    else if (logic_block == 1) {
+        iget(inode_id)->indirect_block1 = block_id;
+    }
+    else if (logic_block == 2) {
+        iget(inode_id)->indirect_block2 = block_id;
+    }
+    else if (logic_block == 3) {
+        iget(inode_id)->indirect_block3 = block_id;
+    }
+    else if (logic_block == 4) {
+        iget(inode_id)->indirect_block4 = block_id;
+    }
+}
+
+/*
+* @brief        Moves the inline contents of a file to its first data block
+* @return       0 if success, -1 in case of error
+*/
+int migrate_inline(int inode_id) {
+    /* Check the validity of argument */
+    if (inode_id < 0 || inode_id >= N_INODES) {
+        perror("migrate_inline: Node id isn't valid\n");
+        return -1;
+    }
+    /* An empty file has nothing to move, its first block will be allocated when it is written */
+    if (iget(inode_id)->size == 0) {
+        iget(inode_id)->inline_data = 0;
+        mark_inode(inode_id);
+        return 0;
+    }
+    /* Copy the inline data to the beginning of the first block, which stays in memory until the file is flushed */
+    if (reserve_block(inode_id, 0) == -1) {
+        return -1;
+    }
+    memmove(fs->inode_x[inode_id].delayed[0], iget(inode_id)->data, iget(inode_id)->size);
+    iget(inode_id)->inline_data = 0;
+    mark_inode(inode_id);
+    memset(iget(inode_id)->data, 0, sizeof(iget(inode_id)->data));
+    return 0;
+}
+
+/*
+* @brief        Reads data of a file starting at an offset, without going beyond the end of the file
+* @return       Number of bytes read
+*/
+int read_data(struct open_file *file, unsigned int offset, void *buffer, int numBytes) {
+    struct iovec iov = { .iov_base = buffer, .iov_len = numBytes < 0 ? 0 : numBytes };
+    return read_datav(file, offset, &iov, 1);
+}
+
+/*
+* @brief        Writes data into a file starting at an offset, without going beyond the maximum size of a file
+* @return       Number of bytes written
+*/
+int write_data(struct open_file *file, unsigned int offset, void *buffer, int numBytes) {
+    struct iovec iov = { .iov_base = buffer, .iov_len = numBytes < 0 ? 0 : numBytes };
+    return write_datav(file, offset, &iov, 1);
+}
+
+/*
+* @brief        Reads data of a file starting at an offset into a list of buffers, without going beyond the end of the file
+* @return       Number of bytes read
+*/
+int read_datav(struct open_file *file, unsigned int offset, const struct iovec *iov, int iovcnt) {
+    int inode_id = file->inode;
+    struct iov_cursor cursor = { iov, iovcnt, 0, 0 };
+    int numBytes = iov_length(iov, iovcnt);
+    /* If the data the user wants to reads exceeds the size of the file we limit it to the maximum space available */
+    if (offset+numBytes > iget(inode_id)->size)
+        numBytes = iget(inode_id)->size - offset;
+
+    /* Small files are read straight from the inode */
+    if (iget(inode_id)->inline_data == 1) {
+        if (numBytes <= 0) {
+            return 0;
+        }
+        iov_copy(&cursor, iget(inode_id)->data+offset, numBytes, 1);
+        return numBytes;
+    }
+
+    char b[MAX_FILE_SIZE];
+    int block_id, block_offset, bytes_read = 0;
+    
+    while (numBytes > 0) {
+        /* Get in which block and where in the block we have to read */
+        block_id = bmap_cache(file, offset);
+        block_offset = offset % BLOCK_SIZE;  
+
+        /* Blocks in memory or not written are read one by one, blocks in the disk as long as they are contiguous */
+        int n_blocks = 1;
+        if (block_id >= 0) {
+            n_blocks = file->map_logical+file->map_length-offset/BLOCK_SIZE;
+            if (n_blocks > (block_offset+numBytes+BLOCK_SIZE-1)/BLOCK_SIZE) {
+                n_blocks = (block_offset+numBytes+BLOCK_SIZE-1)/BLOCK_SIZE;
+            }
+        }
+        int toRead;
+        if (numBytes <= n_blocks*BLOCK_SIZE-block_offset)
+            toRead = numBytes;
+        else
+            toRead = n_blocks*BLOCK_SIZE-block_offset;
+
+        /* Read the blocks from the disk with a single request and scatter them over the buffers */
+        if (block_id == DELAYED_BLOCK) {
+            iov_copy(&cursor, fs->inode_x[inode_id].delayed[offset/BLOCK_SIZE]+block_offset, toRead, 1);
+        }
+        else {
+            if (block_id == -1) {
+                memset(b, 0, BLOCK_SIZE); /* Blocks that were never written read as zeros */
+            }
+            else {
+                struct iovec extent = { .iov_base = b, .iov_len = n_blocks*BLOCK_SIZE };
+                breadv(fs->device, fs->s_block.first_data_block+block_id, &extent, 1);
+            }
+            iov_copy(&cursor, b+block_offset, toRead, 1);
+        }
+
+        /* Update positions of pointers and variables */
+        offset += toRead;
+        numBytes -= toRead;  
+        bytes_read += toRead;      
+    }
+
+    return bytes_read;
+}
+
+/*
+* @brief        Writes data from a list of buffers into a file starting at an offset, without going beyond the maximum size of a file
+* @return       Number of bytes written
+*/
+int write_datav(struct open_file *file, unsigned int offset, const struct iovec *iov, int iovcnt) {
+    int inode_id = file->inode;
+    struct iov_cursor cursor = { iov, iovcnt, 0, 0 };
+    int numBytes = iov_length(iov, iovcnt);
+    char b[MAX_FILE_SIZE];
+    int block_id, block_offset, bytes_written = 0;
+    /* Reads without locks that overlap the write are done again */
+    seq_write_begin(inode_id);
+
+    /* If the data the user wants to write exceeds the size of the file we limit it to the maximum space available */
+    if (offset+numBytes > MAX_FILE_SIZE)
+        numBytes = MAX_FILE_SIZE - offset;
+
+    if (iget(inode_id)->inline_data == 1) {
+        /* While the file fits in the inode we write it there without touching any data block */
+        if (offset+numBytes <= INLINE_SIZE) {
+            if (numBytes <= 0) {
+                return seq_write_end(inode_id, 0);
+            }
+            iov_copy(&cursor, iget(inode_id)->data+offset, numBytes, 0);
+            /* Writing over existing data doesn't make the file larger */
+            if (offset+numBytes > iget(inode_id)->size) {
+                iget(inode_id)->size = offset+numBytes;
+            }
+            mark_inode(inode_id);
+            return seq_write_end(inode_id, numBytes);
+        }
+        /* Otherwise its contents are moved to a data block before writing */
+        if (migrate_inline(inode_id) == -1) {
+            return seq_write_end(inode_id, bytes_written); /* If we can't allocate the data block there is no more space in the disk so we will return 0 */
+        }
+    }
+   
+    while (numBytes > 0) {
+        /* Get the block where we have to write and where in the block */
+        block_id = bmap_cache(file, offset);  
+        block_offset = offset % BLOCK_SIZE;  
+      
+        /* Blocks in memory are written one by one, blocks in the disk as long as they are contiguous */
+        int n_blocks = 1;
+        if (block_id >= 0) {
+            n_blocks = file->map_logical+file->map_length-offset/BLOCK_SIZE;
+            if (n_blocks > (block_offset+numBytes+BLOCK_SIZE-1)/BLOCK_SIZE) {
+                n_blocks = (block_offset+numBytes+BLOCK_SIZE-1)/BLOCK_SIZE;
+            }
+        }
+        int toWrite;
+        if (numBytes <= n_blocks*BLOCK_SIZE-block_offset)
+            toWrite = numBytes;
+        else
+            toWrite = n_blocks*BLOCK_SIZE-block_offset;
+
+        if (block_id == -1) {
+            /* The first time data is written into a block we only reserve space for it, the physical block is chosen when the file is flushed */
+            block_id = reserve_block(inode_id, offset/BLOCK_SIZE);
+            if (block_id == -1) {
+                return seq_write_end(inode_id, bytes_written); /* If we can't reserve a new data block it means there is no more space in the disk so we return the bytes written */
+            }
+        }
+        if (block_id == DELAYED_BLOCK) {
+            /* The block is still in memory, so we don't need to access the disk */
+            iov_copy(&cursor, fs->inode_x[inode_id].delayed[offset/BLOCK_SIZE]+block_offset, toWrite, 0);
+        }
+        else {
+            /* Only the first and last blocks keep part of their old contents, the rest are overwritten completely */
+            int first_data_block = fs->s_block.first_data_block+block_id;
+            if (block_offset != 0) {
+                bread(fs->device, first_data_block, b);
+            }
+            if ((block_offset+toWrite) % BLOCK_SIZE != 0 && (n_blocks > 1 || block_offset == 0)) {
+                bread(fs->device, first_data_block+n_blocks-1, b+(n_blocks-1)*BLOCK_SIZE);
+            }
+            iov_copy(&cursor, b+block_offset, toWrite, 0);
+            struct iovec extent = { .iov_base = b, .iov_len = n_blocks*BLOCK_SIZE };
+            bwritev(fs->device, first_data_block, &extent, 1);
+        }
+
+        /* Update the values of the pointers and variables, writing over existing data doesn't make the file larger */
+        offset += toWrite;
+        if (offset > iget(inode_id)->size) {
+            iget(inode_id)->size = offset;
+            mark_inode(inode_id);
+        }
+        numBytes -= toWrite;
+        bytes_written += toWrite;
+    }
+    
+    return seq_write_end(inode_id, bytes_written);
+}
+
+/*
+* @brief        Computes the number of bytes of a list of buffers
+* @return       The sum of their lengths
+*/
+int iov_length(const struct iovec *iov, int iovcnt) {
+    long length = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        length += iov[i].iov_len;
+    }
+    return length > MAX_FILE_SIZE ? MAX_FILE_SIZE : length;
+}
+
+/*
+* @brief        Copies bytes between a contiguous buffer and the list of buffers of a cursor, moving the cursor forward
+*/
+void iov_copy(struct iov_cursor *cursor, char *data, int numBytes, int to_iov) {
+    while (numBytes > 0 && cursor->index < cursor->iovcnt) {
+        const struct iovec *current = &(cursor->iov[cursor->index]);
+        int length = current->iov_len - cursor->offset;
+        if (length > numBytes) {
+            length = numBytes;
+        }
+        if (to_iov == 1) {
+            memmove((char *) current->iov_base+cursor->offset, data, length);
+        }
+        else {
+            memmove(data, (char *) current->iov_base+cursor->offset, length);
+        }
+        data += length;
+        numBytes -= length;
+        cursor->offset += length;
+        /* Move to the next buffer once this one is done */
+        if (cursor->offset == current->iov_len) {
+            cursor->index++;
+            cursor->offset = 0;
+        }
+    }
+}
+
+/*
+* @brief        Empties the open file table, chaining all the descriptors in the free list
+*/
+void fd_reset() {
+    for (int i = 0; i < MAX_OPEN_FILES; i++) {
+        fs->file_table[i].inode = -1;
+        fs->file_table[i].next_free = i+1 < MAX_OPEN_FILES ? i+1 : -1;
+    }
+    fs->free_fd = 0;
+}
+
+/*
+* @brief        Takes a descriptor from the free list for a file
+* @return       The descriptor, -2 if all of them are in use
+*/
+int fd_alloc(int inode_id, int flags) {
+    pthread_mutex_lock(&(fs->locks.fd));
+    if (fs->free_fd == -1) {
+        pthread_mutex_unlock(&(fs->locks.fd));
+        perror("fd_alloc: Too many open files\n");
+        return -2;
+    }
+    int fd = fs->free_fd;
+    fs->free_fd = fs->file_table[fd].next_free;
+    memset(&(fs->file_table[fd]), 0, sizeof(fs->file_table[fd]));
+    fs->file_table[fd].inode = inode_id;
+    fs->file_table[fd].flags = flags;
+    /* An open file keeps its inode in memory, and the fields that reads need where they can be read without locks */
+    if (ihold(inode_id) == NULL) {
+        fs->file_table[fd].inode = -1;
+        fs->file_table[fd].next_free = fs->free_fd;
+        fs->free_fd = fd;
+        pthread_mutex_unlock(&(fs->locks.fd));
+        return -2;
+    }
+    if (fs->inode_x[inode_id].opens == 0) {
+        seq_publish(inode_id);
+    }
+    fs->inode_x[inode_id].opens++;
+    if (flags == FD_INTEGRITY) {
+        fs->inode_x[inode_id].open_integrity = 1;
+    }
+    pthread_mutex_unlock(&(fs->locks.fd));
+    return fd;
+}
+
+/*
+* @brief        Gets the open file a descriptor refers to
+* @return       A pointer to the entry of the open file table, NULL if the descriptor is not in use
+*/
+struct open_file *fd_get(int fd) {
+    if (fd < 0 || fd >= MAX_OPEN_FILES || fs->file_table[fd].inode == -1) {
+        return NULL;
+    }
+    return &(fs->file_table[fd]);
+}
+
+/*
+* @brief        Returns a descriptor to the free list
+*/
+void fd_free(int fd) {
+    pthread_mutex_lock(&(fs->locks.fd));
+    int inode_id = fs->file_table[fd].inode;
+    if (fs->file_table[fd].flags == FD_INTEGRITY) {
+        fs->inode_x[inode_id].open_integrity = 0;
+    }
+    fs->inode_x[inode_id].opens--;
+    iput(inode_id);
+    fs->file_table[fd].inode = -1;
+    fs->file_table[fd].next_free = fs->free_fd;
+    fs->free_fd = fd;
+    pthread_mutex_unlock(&(fs->locks.fd));
+}
+
+/*
+* @brief        Removes all existing links to the file represented by inode_id
+* @return       0 if success, -1 in case of error
+*/
+int remove_links(int inode_id) {
+    /* Freeing a link takes it out of the list of its target, so we remove the first one until there are none */
+    while (fs->s_block.link_head[inode_id] != -1) {
+        if (ifree(fs->s_block.link_head[inode_id]) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+* @brief        Adds a symbolic link to the list of links pointing to its target
+*/
+void link_add(int link_id, int target) {
+    fs->s_block.link_next[link_id] = fs->s_block.link_head[target];
+    fs->s_block.link_head[target] = link_id;
+    mark_sblock();
+}
+
+/*
+* @brief        Takes a symbolic link out of the list of links pointing to its target
+*/
+void link_remove(int link_id, int target) {
+    int *link = &(fs->s_block.link_head[target]);
+    while (*link != -1 && *link != link_id) {
+        link = &(fs->s_block.link_next[*link]);
+    }
+    if (*link == link_id) {
+        *link = fs->s_block.link_next[link_id];
+    }
+    fs->s_block.link_next[link_id] = -1;
+    mark_sblock();
+}
+
+/*
+* @brief        Initializes the locks of the file system, the ones that can be taken again by the thread holding them are recursive
+*/
+void lock_init() {
+    pthread_mutexattr_t recursive;
+    pthread_mutexattr_init(&recursive);
+    pthread_mutexattr_settype(&recursive, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&(fs->locks.name), &recursive);
+    pthread_mutex_init(&(fs->locks.alloc), &recursive);
+    pthread_mutex_init(&(fs->locks.icache), &recursive);
+    pthread_mutex_init(&(fs->locks.fd), NULL);
+    pthread_mutex_init(&(fs->locks.journal), NULL);
+    pthread_cond_init(&(fs->locks.journal_applied), NULL);
+    pthread_mutexattr_destroy(&recursive);
+    for (int i = 0; i < N_INODES; i++) {
+        pthread_rwlock_init(&(fs->locks.inode[i].rw), NULL);
+    }
+    for (int i = 0; i < ALLOC_CACHES; i++) {
+        pthread_mutex_init(&(fs->caches[i].lock), NULL);
+    }
+}
+
+/*
+* @brief        Destroys the locks of the file system, nobody can be using it
+*/
+void lock_destroy() {
+    pthread_mutex_destroy(&(fs->locks.name));
+    pthread_mutex_destroy(&(fs->locks.alloc));
+    pthread_mutex_destroy(&(fs->locks.icache));
+    pthread_mutex_destroy(&(fs->locks.fd));
+    pthread_mutex_destroy(&(fs->locks.journal));
+    pthread_cond_destroy(&(fs->locks.journal_applied));
+    for (int i = 0; i < N_INODES; i++) {
+        pthread_rwlock_destroy(&(fs->locks.inode[i].rw));
+    }
+    for (int i = 0; i < ALLOC_CACHES; i++) {
+        pthread_mutex_destroy(&(fs->caches[i].lock));
+    }
+}
+
+/*
+* @brief        Takes the lock of the namespace, operations that create, remove or look up names hold it from start to end
+*/
+void names_lock() {
+    pthread_once(&fs->locks_once, lock_init);
+    pthread_mutex_lock(&(fs->locks.name));
+    names_held++;
+}
+
+/*
+* @brief        Releases the lock of the namespace, dropping first the inodes the cache has over its budget
+* @return       The value given, so that it can be used in a return
+*/
+int names_unlock(int ret) {
+    if (names_held == 1) {
+        icache_trim();
+    }
+    names_held--;
+    pthread_mutex_unlock(&(fs->locks.name));
+    return ret;
+}
+
+/*
+* @brief        Takes the lock of the journal, it is not held while the device is synchronized after logging a transaction
+*/
+void journal_lock() {
+    pthread_once(&fs->locks_once, lock_init);
+    pthread_mutex_lock(&(fs->locks.journal));
+}
+
+/*
+* @brief        Releases the lock of the journal
+* @return       The value given, so that it can be used in a return
+*/
+int journal_unlock(int ret) {
+    pthread_mutex_unlock(&(fs->locks.journal));
+    return ret;
+}
+
+/*
+* @brief        Takes the lock of a file to read it, other readers can take it at the same time
+*/
+void inode_rdlock(int inode_id) {
+    pthread_once(&fs->locks_once, lock_init);
+    pthread_rwlock_rdlock(&(fs->locks.inode[inode_id].rw));
+}
+
+/*
+* @brief        Takes the lock of a file to change it, nobody else can hold it meanwhile
+*/
+void inode_wrlock(int inode_id) {
+    pthread_once(&fs->locks_once, lock_init);
+    pthread_rwlock_wrlock(&(fs->locks.inode[inode_id].rw));
+}
+
+/*
+* @brief        Releases the lock of a file
+* @return       The value given, so that it can be used in a return
+*/
+int inode_unlock(int inode_id, int ret) {
+    pthread_rwlock_unlock(&(fs->locks.inode[inode_id].rw));
+    return ret;
+}
+
+/*
+* @brief        Gets the open file a descriptor refers to with the lock of the file taken, for reading or for changing it
+* @return       A pointer to the entry of the open file table, NULL if the descriptor is not in use
+*/
+struct open_file *fd_lock(int fd, int write) {
+    struct open_file *file = fd_get(fd);
+    int inode_id = file != NULL ? file->inode : -1;
+    if (inode_id < 0) {
+        return NULL;
+    }
+    if (write == 1) {
+        inode_wrlock(inode_id);
+    }
+    else {
+        inode_rdlock(inode_id);
+    }
+    /* The file may have been removed while we waited, which closes its descriptors */
+    if (file->inode != inode_id) {
+        inode_unlock(inode_id, 0);
+        return NULL;
+    }
+    return file;
+}
+
+/*
+* @brief        Allocates the data block of a logical block of an inode out of one of the blocks reserved by the caller
+* @return       The id of the allocated block, -1 in case of error, the reservation is kept then
+*/
+int balloc_reserved(int inode_id, int logic_block) {
+    /* The blocks of the cache are already out of the count of available ones, so the one the caller reserved is given back */
+    int block_id = balloc();
+    if (block_id != -1) {
+        atomic_fetch_add(&(fs->avail_blocks), 1);
+    }
+    else {
+        /* The reservation of the caller ensures there is a free block left in the map */
+        block_id = map_claim(fs->block_words, fs->s_block.n_data_blocks);
+        if (block_id == -1) {
+            perror("balloc_reserved: There are no free blocks\n");
+            return -1;
+        }
+        mark_sblock();
+    }
+    set_block(inode_id, logic_block, block_id);
+    return block_id;
+}
+
+/*
+* @brief        Starts a change of the size or the block pointers of a file, by a thread that holds its lock for writing
+*/
+void seq_write_begin(int inode_id) {
+    atomic_fetch_add_explicit(&(fs->inode_seq[inode_id].version), 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+/*
+* @brief        Ends a change of a file, making its new fields visible to reads without locks
+* @return       The value given, so that it can be used in a return
+*/
+int seq_write_end(int inode_id, int ret) {
+    seq_publish(inode_id);
+    atomic_fetch_add_explicit(&(fs->inode_seq[inode_id].version), 1, memory_order_release);
+    return ret;
+}
+
+/*
+* @brief        Copies the fields of an inode that reads without locks need
+*/
+void seq_publish(int inode_id) {
+    struct inode_seq *seq = &(fs->inode_seq[inode_id]);
+    atomic_store_explicit(&(seq->size), iget(inode_id)->size, memory_order_relaxed);
+    atomic_store_explicit(&(seq->inline_data), iget(inode_id)->inline_data, memory_order_relaxed);
+    for (int i = 0; i < MAX_FILE_SIZE/BLOCK_SIZE; i++) {
+        atomic_store_explicit(&(seq->block[i]), bmap(inode_id, i*BLOCK_SIZE), memory_order_relaxed);
+    }
+}
+
+/*
+* @brief        Reads from an open file without taking any lock, checking that no writer changed it meanwhile
+* @return       Number of bytes read, -1 if the file has to be read with its lock taken
+*/
+int read_seq(struct open_file *file, unsigned int offset, void *buffer, int numBytes) {
+    int inode_id = file->inode;
+    if (inode_id < 0) {
+        return -1;
+    }
+    struct inode_seq *seq = &(fs->inode_seq[inode_id]);
+    char b[MAX_FILE_SIZE];
+    for (int attempt = 0; attempt < SEQ_RETRIES; attempt++) {
+        unsigned int version = atomic_load_explicit(&(seq->version), memory_order_acquire);
+        if (version % 2 == 1) {
+            continue;
+        }
+        /* Inline data and data not flushed yet are in memory that changes under the lock of the file */
+        if (atomic_load_explicit(&(seq->inline_data), memory_order_relaxed) == 1) {
+            return -1;
+        }
+        int size = atomic_load_explicit(&(seq->size), memory_order_relaxed);
+        int n = (int) offset < size ? size-(int) offset : 0;
+        if (n > numBytes) {
+            n = numBytes;
+        }
+        /* Read the blocks of the range from the disk, contiguous blocks with a single request */
+        int failed = 0;
+        for (int i = offset/BLOCK_SIZE; n > 0 && i <= (int) (offset+n-1)/BLOCK_SIZE; ) {
+            int block_id = atomic_load_explicit(&(seq->block[i]), memory_order_relaxed);
+            if (block_id == DELAYED_BLOCK) {
+                return -1;
+            }
+            int length = 1;
+            while (block_id >= 0 && i+length <= (int) (offset+n-1)/BLOCK_SIZE && atomic_load_explicit(&(seq->block[i+length]), memory_order_relaxed) == block_id+length) {
+                length++;
+            }
+            if (block_id == -1) {
+                memset(b+i*BLOCK_SIZE, 0, BLOCK_SIZE);
+            }
+            else {
+                struct iovec extent = { .iov_base = b+i*BLOCK_SIZE, .iov_len = length*BLOCK_SIZE };
+                failed |= breadv(fs->device, fs->s_block.first_data_block+block_id, &extent, 1) == -1;
+            }
+            i += length;
+        }
+        /* The data is only given to the caller if no writer started meanwhile */
+        atomic_thread_fence(memory_order_acquire);
+        if (failed == 0 && atomic_load_explicit(&(seq->version), memory_order_relaxed) == version) {
+            memmove(buffer, b+offset, n);
+            return n;
+        }
+    }
+    return -1;
+}
+
+/*
+* @brief        Makes the calling thread work on the file system of a context
+* @return       The context the thread was working on, to go back to it with fs_unbind()
+*/
+struct fs_ctx *fs_bind(struct fs_ctx *ctx) {
+    struct fs_ctx *prev = fs;
+    fs = ctx;
+    return prev;
+}
+
+/*
+* @brief        Makes the calling thread go back to the context it was working on
+* @return       The value given, so that it can be used in a return
+*/
+int fs_unbind(struct fs_ctx *prev, int ret) {
+    fs = prev;
+    return ret;
+}
+
+/*
+* @brief        Creates the context of a file system that is not mounted yet
+* @return       The new context, NULL in case of error
+*/
+struct fs_ctx *ctx_alloc(const char *device) {
+    if (device == NULL || strlen(device) >= DEVICE_PATH) {
+        perror("ctx_alloc: Path of the device isn't valid\n");
+        return NULL;
+    }
+    /* The locks of the context are aligned to cache lines, and so is the context */
+    struct fs_ctx *ctx = aligned_alloc(CACHE_LINE, sizeof(struct fs_ctx));
+    if (ctx == NULL) {
+        perror("ctx_alloc: Couldn't allocate memory for the context\n");
+        return NULL;
+    }
+    memset(ctx, 0, sizeof(struct fs_ctx));
+    strcpy(ctx->device, device);
+    ctx->journal_head = 1;
+    ctx->journal_sequence = 1;
+    pthread_once_t once = PTHREAD_ONCE_INIT;
+    ctx->locks_once = once;
+    return ctx;
+}
+
+/*
+* @brief        Frees a context that is not mounted, destroying its locks
+*/
+void ctx_free(struct fs_ctx *ctx) {
+    struct fs_ctx *prev = fs_bind(ctx);
+    /* The locks are created the first time they are used, so they are created now if they weren't to destroy all of them */
+    pthread_once(&fs->locks_once, lock_init);
+    lock_destroy();
+    fs_unbind(prev, 0);
+    free(ctx);
+}
+
+/*
+* @brief        Checks the integrity of a closed file that includes it
+* @return       0 if it is not corrupted, -1 if it is
+*/
+int check_inode(int inode_id) {
+    /* Get the hash value of the current contents of the file, through a descriptor of our own */
+    struct Inode *inode = ihold(inode_id);
+    if (inode == NULL) {
+        return -1;
+    }
+    int size = inode->size;
+    struct open_file file = { .inode = inode_id };
+    unsigned char buffer[MAX_FILE_SIZE];
+    read_data(&file, 0, buffer, size);
+    uint32_t check = CRC32(buffer, size);
+
+    /* Check that the value corresponds to the one already stored in the inode */
+    int ret = check == inode->integrity ? 0 : -1;
+    iput(inode_id);
+    return ret;
+}
+
+/*
+* @brief        Task of mkFS() that writes zeros to a range of data blocks
+*/
+void zero_blocks(int index, void *arg) {
+    struct bulk_job *job = arg;
+    struct fs_ctx *prev = fs_bind(job->ctx);
+    static char zeros[ZERO_BLOCKS*BLOCK_SIZE];
+    int first = index*ZERO_BLOCKS;
+    int n_blocks = fs->s_block.n_data_blocks-first < ZERO_BLOCKS ? fs->s_block.n_data_blocks-first : ZERO_BLOCKS;
+    struct iovec iov = { .iov_base = zeros, .iov_len = n_blocks*BLOCK_SIZE };
+    if (bwritev(fs->device, fs->s_block.first_data_block+first, &iov, 1) == -1) {
+        atomic_fetch_add(&(job->failed), 1);
+    }
+    fs_unbind(prev, 0);
+}
+
+/*
+* @brief        Task of checkAllFiles() that checks the integrity of one of its files
+*/
+void check_files(int index, void *arg) {
+    struct bulk_job *job = arg;
+    struct fs_ctx *prev = fs_bind(job->ctx);
+    if (check_inode(job->inodes[index]) == -1) {
+        atomic_fetch_add(&(job->failed), 1);
+    }
+    fs_unbind(prev, 0);
+}
+
+/*
+* @brief        Gets the allocation cache of the calling thread in the file system it is working on
+* @return       The cache
+*/
+struct alloc_cache *cache_get() {
+    if (cache_slot == -1) {
+        cache_slot = atomic_fetch_add(&n_threads, 1) % ALLOC_CACHES;
+    }
+    return &(fs->caches[cache_slot]);
+}
+
+/*
+* @brief        Fills an allocation cache with free data blocks of the map, with the lock of the cache taken
+* @return       Number of blocks claimed from the map
+*/
+int cache_fill_blocks(struct alloc_cache *cache) {
+    int first = cache->n_blocks;
+    /* Blocks reserved for delayed data cannot be given to anybody else */
+    while (cache->n_blocks < CACHE_BLOCKS && avail_take(1) == 0) {
+        int block_id = map_claim(fs->block_words, fs->s_block.n_data_blocks);
+        if (block_id == -1) {
+            atomic_fetch_add(&(fs->avail_blocks), 1);
+            break;
+        }
+        cache->blocks[cache->n_blocks++] = block_id;
+    }
+    /* The cache is taken from the end, so the blocks are reversed to give them in the order they were claimed */
+    for (int i = first, j = cache->n_blocks-1; i < j; i++, j--) {
+        int block_id = cache->blocks[i];
+        cache->blocks[i] = cache->blocks[j];
+        cache->blocks[j] = block_id;
+    }
+    return cache->n_blocks-first;
+}
+
+/*
+* @brief        Gives back to the map the blocks of all the allocation caches
+*/
+void cache_reclaim() {
+    /* The lock keeps the superblock from being written while the caches are emptied */
+    pthread_mutex_lock(&(fs->locks.alloc));
+    for (int i = 0; i < ALLOC_CACHES; i++) {
+        cache_empty(&(fs->caches[i]));
+    }
+    pthread_mutex_unlock(&(fs->locks.alloc));
+}
+
+/*
+* @brief        Gives back to the map the blocks left in the allocation cache of the calling thread, once its operation stops allocating
+*/
+void cache_release() {
+    if (cache_slot == -1) {
+        return;
+    }
+    pthread_mutex_lock(&(fs->locks.alloc));
+    cache_empty(&(fs->caches[cache_slot]));
+    pthread_mutex_unlock(&(fs->locks.alloc));
+}
+
+/*
+* @brief        Gives back to the map the blocks of an allocation cache, with the allocator lock taken
+*/
+void cache_empty(struct alloc_cache *cache) {
+    pthread_mutex_lock(&(cache->lock));
+    for (int j = 0; j < cache->n_blocks; j++) {
+        bitmap_setbit_atomic(fs->block_words, cache->blocks[j], 0);
+        atomic_fetch_add(&(fs->avail_blocks), 1);
+    }
+    cache->n_blocks = 0;
+    pthread_mutex_unlock(&(cache->lock));
+}
+
+/*
+* @brief        Fills a buffer with the superblock as it is stored in the disk, with the maps copied from their words and the blocks of the allocation caches
+*               and the ones waiting for their transaction free
+*/
+void pack_sblock(char *buffer) {
+    pthread_mutex_lock(&(fs->locks.alloc));
+    memmove(buffer, &(fs->s_block), BLOCK_SIZE);
+    Superblock *s_block = (Superblock *) buffer;
+    for (int i = 0; i < fs->s_block.n_data_blocks; i++) {
+        bitmap_setbit(s_block->block_map, i, bitmap_getbit_atomic(fs->block_words, i));
+    }
+    for (int i = 0; i < N_INODES; i++) {
+        bitmap_setbit(s_block->inode_map, i, bitmap_getbit_atomic(fs->inode_words, i));
+    }
+    for (int i = 0; i < ALLOC_CACHES; i++) {
+        struct alloc_cache *cache = &(fs->caches[i]);
+        pthread_mutex_lock(&(cache->lock));
+        for (int j = 0; j < cache->n_blocks; j++) {
+            bitmap_setbit(s_block->block_map, cache->blocks[j], 0);
+        }
+        pthread_mutex_unlock(&(cache->lock));
+    }
+    for (int i = fs->released_total; i < fs->freed_total; i++) {
+        bitmap_setbit(s_block->block_map, fs->freed[i % MAX_DATA_BLOCKS], 0);
+    }
+    pthread_mutex_unlock(&(fs->locks.alloc));
+}
+
+/*
+* @brief        Takes free data blocks out of the count of the available ones, as long as there are enough
+* @return       0 if success, -1 if there are not enough free blocks that are not promised
+*/
+int avail_take(int n_blocks) {
+    int avail = atomic_load(&(fs->avail_blocks));
+    do {
+        if (avail < n_blocks) {
+            return -1;
+        }
+    } while (!atomic_compare_exchange_weak(&(fs->avail_blocks), &avail, avail-n_blocks));
+    return 0;
+}
+
+/*
+* @brief        Claims a free bit of a map, starting the search at a different place for each thread so that they don't compete for the same word
+* @return       The bit claimed, -1 if all of them are set
+*/
+int map_claim(_Atomic uint64_t *words, int n_bits) {
+    int n_words = bitmap_words(n_bits);
+    int start = cache_slot < 0 ? 0 : cache_slot*n_bits/ALLOC_CACHES;
+    /* A bit freed behind the search is only seen in a second pass */
+    for (int pass = 0; pass < 2; pass++) {
+        for (int k = 0; k <= n_words; k++) {
+            int w = (start/BITMAP_WORD+k) % n_words;
+            /* Bits past the end of the map don't exist, and in the first word the ones before the start are left for the last round */
+            uint64_t valid = ~(uint64_t) 0;
+            if (w == n_words-1 && n_bits % BITMAP_WORD != 0) {
+                valid = ((uint64_t) 1 << (n_bits % BITMAP_WORD))-1;
+            }
+            if (k == 0) {
+                valid &= ~(uint64_t) 0 << (start % BITMAP_WORD);
+            }
+            uint64_t word = atomic_load(&words[w]);
+            while ((~word & valid) != 0) {
+                /* Claim the first free bit, if the word changed meanwhile look at it again */
+                uint64_t bit = ~word & valid & -(~word & valid);
+                if (atomic_compare_exchange_weak(&words[w], &word, word | bit)) {
+                    return w*BITMAP_WORD+__builtin_ctzll(bit);
+                }
+            }
+        }
+    }
+    return -1;
+}
@@ -42,6 +42,12 @@ int mountFS(void);
  */
 int unmountFS(void);
 
+/*
+ * @brief 	Writes to the device the data and metadata that changed since the last synchronization.
+ * @return 	0 if success, -1 otherwise.
+ */
+int fs_sync(void);
+
 /*
  * @brief	Creates a new file, provided it it doesn't exist in the file system.
  * @return	0 if success, -1 if the file already exists, -2 in case of error.
@@ -84,6 +90,36 @@ int writeFile(int fileDescriptor, void *buffer, int numBytes);
  */
 int lseekFile(int fileDescriptor, long offset, int whence);
 
+/*
+ * @brief	Reads a number of bytes from a position of a file, without moving its seek pointer.
+ * @return	Number of bytes properly read, -1 in case of error.
+ */
+int preadFile(int fileDescriptor, void *buffer, int numBytes, long offset);
+
+/*
+ * @brief	Writes a number of bytes into a position of a file, without moving its seek pointer.
+ * @return	Number of bytes properly written, -1 in case of error.
+ */
+int pwriteFile(int fileDescriptor, void *buffer, int numBytes, long offset);
+
+/*
+ * @brief	Reads from a file into a list of buffers, filling each one before the next.
+ * @return	Number of bytes properly read, -1 in case of error.
+ */
+int readvFile(int fileDescriptor, const struct iovec *iov, int iovcnt);
+
+/*
+ * @brief	Writes into a file the contents of a list of buffers, one after the other.
+ * @return	Number of bytes properly written, -1 in case of error.
+ */
+int writevFile(int fileDescriptor, const struct iovec *iov, int iovcnt);
+
+/*
+ * @brief	Allocates the data blocks of a range of a file in advance, contiguously when possible. The size of the file does not change.
+ * @return	0 if success, -1 in case of error, -2 if the file system is not mounted.
+ */
+int fallocateFile(int fileDescriptor, long offset, long length);
+
 
 /*
  * @brief	Checks the integrity of the file.
@@ -91,6 +127,12 @@ int lseekFile(int fileDescriptor, long offset, int whence);
  */
 int checkFile (char * fileName);
 
+/*
+ * @brief	Checks the integrity of all the closed files that include it, several files at a time.
+ * @return	Number of corrupted files, -1 in case of error.
+ */
+int checkAllFiles(void);
+
 /*
  * @brief	Include integrity on a file.
  * @return	0 if success, -1 if the file does not exists, -2 in case of error.
@@ -111,6 +153,18 @@ int openFileIntegrity(char *fileName);
  */
 int closeFileIntegrity(int fileDescriptor);
 
+/*
+ * @brief	Creates a new directory, provided its parent directory exists and the name is not in use.
+ * @return	0 if success, -1 if the name already exists, -2 in case of error.
+ */
+int mkDir(char *path);
+
+/*
+ * @brief	Deletes an empty directory.
+ * @return	0 if success, -1 if the directory does not exist, -2 in case of error.
+ */
+int rmDir(char *path);
+
 /*
  * @brief	Creates a symbolic link to an existing file in the file system.
  * @return	0 if success, -1 if file does not exist, -2 in case of error.
@@ -123,6 +177,173 @@ int createLn(char *fileName, char *linkName);
  */
 int removeLn(char *linkName);
 
+/*
+ * @brief	Creates a hard link, another name for an existing regular file.
+ * @return	0 if success, -1 if file does not exist, -2 in case of error.
+ */
+int createHardLn(char *fileName, char *linkName);
+
+/*
+ * Functions on a file system given by a context, so that a process can use several device images at the same
+ * time, from as many threads as needed. The functions above work on a default context, the device DEVICE_IMAGE.
+ */
+typedef struct fs_ctx fs_ctx;
+
+/*
+ * @brief 	Generates the proper file system structure in the device image given.
+ * @return 	0 if success, -1 otherwise.
+ */
+int ctx_mkFS(const char *device, long deviceSize);
+
+/*
+ * @brief 	Mounts the file system of the device image given.
+ * @return 	The context of the file system if success, NULL otherwise.
+ */
+fs_ctx *ctx_mountFS(const char *device);
+
+/*
+ * @brief 	Unmounts a file system, the context can't be used anymore.
+ * @return 	0 if success, -1 otherwise.
+ */
+int ctx_unmountFS(fs_ctx *ctx);
+
+/*
+ * @brief	Writes to the device the data and metadata that changed since the last synchronization.
+ * @return	0 if success, -1 otherwise.
+ */
+int ctx_fs_sync(fs_ctx *ctx);
+
+/*
+ * @brief	Creates a new file, provided it it doesn't exist in the file system.
+ * @return	0 if success, -1 if the file already exists, -2 in case of error.
+ */
+int ctx_createFile(fs_ctx *ctx, char *path);
+
+/*
+ * @brief	Deletes a file, provided it exists in the file system.
+ * @return	0 if success, -1 if the file does not exist, -2 in case of error..
+ */
+int ctx_removeFile(fs_ctx *ctx, char *path);
+
+/*
+ * @brief	Opens an existing file.
+ * @return	The file descriptor if possible, -1 if file does not exist, -2 in case of error..
+ */
+int ctx_openFile(fs_ctx *ctx, char *path);
+
+/*
+ * @brief	Closes a file.
+ * @return	0 if success, -1 otherwise.
+ */
+int ctx_closeFile(fs_ctx *ctx, int fileDescriptor);
+
+/*
+ * @brief	Reads a number of bytes from a file and stores them in a buffer.
+ * @return	Number of bytes properly read, -1 in case of error.
+ */
+int ctx_readFile(fs_ctx *ctx, int fileDescriptor, void *buffer, int numBytes);
+
+/*
+ * @brief	Writes a number of bytes from a buffer and into a file.
+ * @return	Number of bytes properly written, -1 in case of error.
+ */
+int ctx_writeFile(fs_ctx *ctx, int fileDescriptor, void *buffer, int numBytes);
+
+/*
+ * @brief	Modifies the position of the seek pointer of a file.
+ * @return	0 if succes, -1 otherwise.
+ */
+int ctx_lseekFile(fs_ctx *ctx, int fileDescriptor, long offset, int whence);
+
+/*
+ * @brief	Reads a number of bytes from a position of a file, without moving its seek pointer.
+ * @return	Number of bytes properly read, -1 in case of error.
+ */
+int ctx_preadFile(fs_ctx *ctx, int fileDescriptor, void *buffer, int numBytes, long offset);
+
+/*
+ * @brief	Writes a number of bytes into a position of a file, without moving its seek pointer.
+ * @return	Number of bytes properly written, -1 in case of error.
+ */
+int ctx_pwriteFile(fs_ctx *ctx, int fileDescriptor, void *buffer, int numBytes, long offset);
+
+/*
+ * @brief	Reads from a file into a list of buffers, filling each one before the next.
+ * @return	Number of bytes properly read, -1 in case of error.
+ */
+int ctx_readvFile(fs_ctx *ctx, int fileDescriptor, const struct iovec *iov, int iovcnt);
+
+/*
+ * @brief	Writes into a file the contents of a list of buffers, one after the other.
+ * @return	Number of bytes properly written, -1 in case of error.
+ */
+int ctx_writevFile(fs_ctx *ctx, int fileDescriptor, const struct iovec *iov, int iovcnt);
+
+/*
+ * @brief	Allocates the data blocks of a range of a file in advance, contiguously when possible. The size of the file does not change.
+ * @return	0 if success, -1 in case of error, -2 if the file system is not mounted.
+ */
+int ctx_fallocateFile(fs_ctx *ctx, int fileDescriptor, long offset, long length);
+
+/*
+ * @brief	Checks the integrity of the file.
+ * @return	0 if success, -1 if the file is corrupted, -2 in case of error.
+ */
+int ctx_checkFile(fs_ctx *ctx, char *fileName);
+
+/*
+ * @brief	Checks the integrity of all the closed files that include it, several files at a time.
+ * @return	Number of corrupted files, -1 in case of error.
+ */
+int ctx_checkAllFiles(fs_ctx *ctx);
+
+/*
+ * @brief	Include integrity on a file.
+ * @return	0 if success, -1 if the file does not exists, -2 in case of error.
+ */
+int ctx_includeIntegrity(fs_ctx *ctx, char *fileName);
+
+/*
+ * @brief	Opens an existing file and checks its integrity
+ * @return	The file descriptor if possible, -1 if file does not exist, -2 if the file is corrupted, -3 in case of error
+ */
+int ctx_openFileIntegrity(fs_ctx *ctx, char *fileName);
+
+/*
+ * @brief	Closes a file and updates its integrity.
+ * @return	0 if success, -1 otherwise.
+ */
+int ctx_closeFileIntegrity(fs_ctx *ctx, int fileDescriptor);
+
+/*
+ * @brief	Creates a new directory, provided its parent directory exists and the name is not in use.
+ * @return	0 if success, -1 if the name already exists, -2 in case of error.
+ */
+int ctx_mkDir(fs_ctx *ctx, char *path);
+
+/*
+ * @brief	Deletes an empty directory.
+ * @return	0 if success, -1 if the directory does not exist, -2 in case of error.
+ */
+int ctx_rmDir(fs_ctx *ctx, char *path);
+
+/*
+ * @brief	Creates a symbolic link to an existing file in the file system.
+ * @return	0 if success, -1 if file does not exist, -2 in case of error.
+ */
+int ctx_createLn(fs_ctx *ctx, char *fileName, char *linkName);
+
+/*
+ * @brief	Deletes an existing symbolic link
+ * @return	0 if the file is correct, -1 if the symbolic link does not exist, -2 in case of error.
+ */
+int ctx_removeLn(fs_ctx *ctx, char *linkName);
+
+/*
+ * @brief	Creates a hard link, another name for an existing regular file.
+ * @return	0 if success, -1 if file does not exist, -2 in case of error.
+ */
+int ctx_createHardLn(fs_ctx *ctx, char *fileName, char *linkName);
 
 
 #endif
@@ -9,15 +9,50 @@
  * @date	Last revision 01/04/2020
  *
  */
+
+#include <stdint.h>
+#include <stdatomic.h>
+
 #define MAGIC_NUM 1234
 #define N_INODES 48
 #define NAME_LENGTH 32
 #define INODES_BLOCK 16
 #define MIN_SIZE_DISK 460*1024
 #define MAX_SIZE_DISK 600*1024
+#define INLINE_SIZE ((BLOCK_SIZE/INODES_BLOCK)-13*4-NAME_LENGTH) /* Bytes of data that can be stored inside the inode */
+#define ROOT_INODE N_INODES /* The root directory has no inode, this is the parent of the files stored in it */
+#define DCACHE_SIZE 64 /* Number of entries of the directory entry cache */
+#define INDEX_BUCKETS 64 /* Number of buckets of the name index */
+#define BLOOM_SIZE 1024 /* Number of counters of the filter of existing names */
+#define BLOOM_HASHES 3 /* Number of counters each name sets in the filter */
+#define INODE_EAGER_BLOCKS 1 /* Number of inode blocks read when mounting, the rest are read the first time they are used */
+#define INODE_CACHE_SIZE 16 /* Number of inodes kept in memory, it is only exceeded by open inodes and by changed inodes until they are committed */
+#define ICACHE_BUCKETS 16 /* Number of buckets of the inode cache */
+#define MAX_OPEN_FILES 64 /* Number of entries of the open file table */
+#define DEVICE_PATH 256 /* Maximum length of the path of a device image */
+#define CACHE_LINE 64 /* Bytes of a line of the processor cache, data written by different threads is kept in different lines */
+#define SEQ_RETRIES 4 /* Times a file is read without taking its lock before giving up and taking it */
+#define ZERO_BLOCKS 16 /* Number of data blocks mkFS writes zeros to in each of its tasks */
+#define ALLOC_CACHES 8 /* Number of allocation caches of a file system, each thread uses one of them and threads beyond this number share them */
+#define CACHE_BLOCKS 8 /* Free data blocks an allocation cache takes from the block map at once */
+#define MAX_DATA_BLOCKS ((MAX_SIZE_DISK/BLOCK_SIZE)-1-N_INODES/INODES_BLOCK) /* Data blocks of a device of the maximum size */
+#define BITMAP_WORD 64 /* Bits of each word of the maps in memory, which are changed with atomic operations */
+#define JOURNAL_BLOCKS 16 /* Number of blocks of the journal, the first one is its header */
+#define JOURNAL_MAX_BLOCKS (1+N_INODES/INODES_BLOCK) /* Metadata blocks a transaction can log: the superblock and all inode blocks */
+#define JOURNAL_GROUP 8 /* Number of operations committed together */
+#define JOURNAL_MAGIC 0x4a524e4c
+#define JOURNAL_DESCRIPTOR 0x44455343
+#define JOURNAL_COMMIT 0x434d4954
 
 #define REGULAR 0
 #define SYM_LINK 1
+#define DIRECTORY 2
+#define HARD_LINK 3 /* Additional name of a regular file, it resolves straight to the file */
+
+#define FD_PLAIN 0     /* Descriptor opened with openFile */
+#define FD_INTEGRITY 1 /* Descriptor opened with openFileIntegrity */
+
+#define DELAYED_BLOCK -2 /* Block pointer of a block whose data is still in memory and has no physical block yet */
 
 
 #define bitmap_getbit(bitmap_, i_) (bitmap_[i_ >> 3] & (1 << (i_ & 0x07)))
@@ -28,6 +63,18 @@ static inline void bitmap_setbit(char *bitmap_, int i_, int val_) {
     bitmap_[(i_ >> 3)] &= ~(1 << (i_ & 0x07));
 }
 
+/* Maps in memory are arrays of atomic words, so that several threads can claim and free bits without a lock */
+#define bitmap_words(n_bits_) (((n_bits_)+BITMAP_WORD-1)/BITMAP_WORD)
+#define bitmap_getbit_atomic(words_, i_) ((atomic_load(&(words_)[(i_) >> 6]) >> ((i_) & 0x3f)) & 1)
+/* Returns the value the bit had, so that a thread setting it knows whether it claimed it or another one already had */
+static inline int bitmap_setbit_atomic(_Atomic uint64_t *words_, int i_, int val_) {
+  uint64_t mask_ = (uint64_t) 1 << (i_ & 0x3f);
+  if (val_)
+    return (atomic_fetch_or(&words_[i_ >> 6], mask_) & mask_) != 0;
+  else
+    return (atomic_fetch_and(&words_[i_ >> 6], ~mask_) & mask_) != 0;
+}
+
 typedef struct Superblock {
     int magic_number;
     int n_inodes; /* Number of inodes on the device */
@@ -35,16 +82,25 @@ typedef struct Superblock {
     int n_data_blocks; /* Number of data blocks on the device */
     int first_data_block; /* Logical address of the first data block */
     int device_size; /* Total device size in bytes*/
+    int journal_start; /* Logical address of the journal, the last blocks of the device */
+    int n_journal_blocks; /* Number of blocks of the journal */
+    int index_head[INDEX_BUCKETS]; /* First inode of each bucket of the name index, -1 if the bucket is empty */
+    int index_next[N_INODES]; /* Next inode in the same bucket of the name index, -1 at the end of the bucket */
+    unsigned int index_hash[N_INODES]; /* Hash of the parent directory and name of each inode */
+    int link_head[N_INODES]; /* First symbolic link pointing to each inode, -1 if there is none */
+    int link_next[N_INODES]; /* Next symbolic link pointing to the same inode, -1 at the end of the list */
     char inode_map[N_INODES/8];  /* Number of blocks of the inode map*/
-    char block_map[((MAX_SIZE_DISK/BLOCK_SIZE)-1-N_INODES/INODES_BLOCK)/8]; /* Number of blocks of the data map */
-    char padding[BLOCK_SIZE-6*4-N_INODES/8-((MAX_SIZE_DISK/BLOCK_SIZE)-1-N_INODES/INODES_BLOCK)/8]; /* Padding to fill a block */
+    char block_map[MAX_DATA_BLOCKS/8]; /* Number of blocks of the data map */
+    char padding[BLOCK_SIZE-8*4-(INDEX_BUCKETS+4*N_INODES)*4-N_INODES/8-MAX_DATA_BLOCKS/8]; /* Padding to fill a block */
 } Superblock;
 
 typedef struct Inode {
-    int type; /* REGULAR or SYM_LINK */
-    char name[NAME_LENGTH]; /* Name of the associated file or link */
-    int inode; /* Id of referenced inode in case it is a symbolic link */
-    int size; /* File size in bytes */
+    int type; /* REGULAR, SYM_LINK, DIRECTORY or HARD_LINK */
+    char name[NAME_LENGTH]; /* Name of the associated file, link or directory inside its parent directory */
+    int parent; /* Id of the directory inode containing it, ROOT_INODE for the root directory */
+    int inode; /* Id of referenced inode in case it is a symbolic or hard link */
+    int nlink; /* Number of names of the file, it is freed when the last one is removed */
+    int size; /* File size in bytes, number of entries in the case of a directory */
     int direct_block; /* Direct block number */
     int indirect_block1; /* Indirect block number */
     int indirect_block2; /* Indirect block number */
@@ -52,5 +108,27 @@ typedef struct Inode {
     int indirect_block4; /* Indirect block number */
     int includes_integrity; /* Whether the file includes integrity or not */
     uint32_t integrity; /* CRC checksum */
-    char padding[(BLOCK_SIZE/INODES_BLOCK)-10*4-NAME_LENGTH]; /* Padding, we will have 16 inodes per block so each inode will fill 128 bytes */
+    int inline_data; /* Whether the contents of the file are stored in the inode instead of in data blocks */
+    char data[INLINE_SIZE]; /* Inline contents, it fills the rest of the inode so each inode will fill 128 bytes */
 } Inode;
+
+typedef struct JournalHeader {
+    int magic; /* JOURNAL_MAGIC */
+    int sequence; /* Sequence number of the transaction stored right after the header */
+    char padding[BLOCK_SIZE-2*4]; /* Padding to fill a block */
+} JournalHeader;
+
+typedef struct JournalDescriptor {
+    int magic; /* JOURNAL_DESCRIPTOR */
+    int sequence; /* Sequence number of the transaction */
+    int n_blocks; /* Number of metadata blocks logged after the descriptor */
+    int blocks[JOURNAL_MAX_BLOCKS]; /* Address of each logged block in the device */
+    char padding[BLOCK_SIZE-(3+JOURNAL_MAX_BLOCKS)*4]; /* Padding to fill a block */
+} JournalDescriptor;
+
+typedef struct JournalCommit {
+    int magic; /* JOURNAL_COMMIT */
+    int sequence; /* Sequence number of the transaction */
+    uint32_t checksum; /* CRC of the descriptor and the logged blocks */
+    char padding[BLOCK_SIZE-3*4]; /* Padding to fill a block */
+} JournalCommit;
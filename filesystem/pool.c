@@ -0,0 +1,230 @@
+
+/*
+ *
+ * Operating System Design / Diseño de Sistemas Operativos
+ * (c) ARCOS.INF.UC3M.ES
+ *
+ * @file 	pool.c
+ * @brief 	Implementation of the pool of threads with a queue of tasks per worker.
+ * @date	Last revision 18/10/2026
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "filesystem/blocks_cache.h" // Headers for block managing (read/write)
+#include "filesystem/metadata.h"     // Type and structure declaration of the file system
+#include "filesystem/pool.h"         // Headers for the pool of threads
+
+struct pool_job {
+  void (*task)(int index, void *arg);
+  void *arg;
+  int remaining;                  /* Tasks not done yet */
+  pthread_mutex_t lock;
+  pthread_cond_t done;            /* Signaled when the last task is done */
+};
+
+struct pool_task {
+  struct pool_job *job;
+  int index;
+};
+
+/* Its owner takes tasks from the bottom, the rest of the workers steal them from the top */
+struct pool_deque {
+  _Alignas(CACHE_LINE) pthread_mutex_t lock;
+  struct pool_task *tasks;        /* Circular buffer, its capacity is a power of 2 */
+  int capacity;
+  int top;                        /* Tasks queued are the ones from top to bottom-1 */
+  int bottom;
+};
+
+struct pool {
+  pthread_once_t once;
+  pthread_mutex_t lock;
+  pthread_cond_t queued;          /* Signaled when tasks are queued */
+  atomic_int n_queued;            /* Tasks queued in all the deques */
+  int n_workers;
+  pthread_t workers[POOL_WORKERS];
+  struct pool_deque deques[POOL_WORKERS];
+};
+
+struct pool pool = { .once = PTHREAD_ONCE_INIT };
+_Thread_local int pool_self = -1; /* Deque of the calling thread, -1 if it isn't a worker */
+
+void pool_init();
+void *pool_worker(void *arg);
+int pool_push(struct pool_deque *deque, struct pool_task task);
+int pool_take(struct pool_task *task);
+void pool_execute(struct pool_task *task);
+
+/*
+ * @brief	Runs task(index, arg) for every index from 0 to n_tasks-1 and waits until all of them are done.
+ * 		The tasks are spread over the workers of the pool, workers that run out of tasks take them from
+ * 		the others, and the caller runs tasks too while it waits. Tasks may run pool_run() themselves.
+ */
+void pool_run(int n_tasks, void (*task)(int index, void *arg), void *arg)
+{
+    if (n_tasks <= 0) {
+        return;
+    }
+    pthread_once(&(pool.once), pool_init);
+    struct pool_job job = { .task = task, .arg = arg, .remaining = n_tasks };
+    pthread_mutex_init(&(job.lock), NULL);
+    pthread_cond_init(&(job.done), NULL);
+
+    /* Counted before they are queued, so that a task can't be taken before it is counted */
+    atomic_fetch_add(&(pool.n_queued), n_tasks);
+    /* Each worker gets a range of consecutive tasks, queued so that it takes them in order and thieves take the last ones */
+    for (int w = 0; w < pool.n_workers; w++) {
+        int first = (long) n_tasks*w/pool.n_workers;
+        int last = (long) n_tasks*(w+1)/pool.n_workers;
+        for (int i = last-1; i >= first; i--) {
+            struct pool_task t = { &job, i };
+            if (pool_push(&(pool.deques[w]), t) == -1) {
+                /* Tasks that couldn't be queued are done here */
+                atomic_fetch_sub(&(pool.n_queued), 1);
+                pool_execute(&t);
+            }
+        }
+    }
+    pthread_mutex_lock(&(pool.lock));
+    pthread_cond_broadcast(&(pool.queued));
+    pthread_mutex_unlock(&(pool.lock));
+
+    /* Help with the tasks queued, once there are none left the ones of this job still running are being done by others.
+       As the caller takes tasks from every deque, they are all done even if some worker couldn't be started */
+    struct pool_task t;
+    while (pool_take(&t) == 0) {
+        pool_execute(&t);
+    }
+    pthread_mutex_lock(&(job.lock));
+    while (job.remaining > 0) {
+        pthread_cond_wait(&(job.done), &(job.lock));
+    }
+    pthread_mutex_unlock(&(job.lock));
+    pthread_cond_destroy(&(job.done));
+    pthread_mutex_destroy(&(job.lock));
+}
+
+/*
+* @brief        Starts the workers of the pool, the first time it is used
+*/
+void pool_init() {
+    pthread_mutex_init(&(pool.lock), NULL);
+    pthread_cond_init(&(pool.queued), NULL);
+    long n_workers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n_workers < 1) {
+        n_workers = 1;
+    }
+    if (n_workers > POOL_WORKERS) {
+        n_workers = POOL_WORKERS;
+    }
+    pool.n_workers = n_workers;
+    for (int w = 0; w < n_workers; w++) {
+        pthread_mutex_init(&(pool.deques[w].lock), NULL);
+    }
+    /* Workers live as long as the process does */
+    for (int w = 0; w < n_workers; w++) {
+        if (pthread_create(&(pool.workers[w]), NULL, pool_worker, (void *) (long) w) != 0) {
+            perror("pool_init: Couldn't create a worker\n");
+            continue;
+        }
+        pthread_detach(pool.workers[w]);
+    }
+}
+
+/*
+* @brief        Does the tasks of its deque and, when it is empty, the ones it steals from the rest
+* @return       NULL
+*/
+void *pool_worker(void *arg) {
+    pool_self = (long) arg;
+    struct pool_task t;
+    while (1) {
+        if (pool_take(&t) == 0) {
+            pool_execute(&t);
+            continue;
+        }
+        pthread_mutex_lock(&(pool.lock));
+        while (atomic_load(&(pool.n_queued)) == 0) {
+            pthread_cond_wait(&(pool.queued), &(pool.lock));
+        }
+        pthread_mutex_unlock(&(pool.lock));
+    }
+    return NULL;
+}
+
+/*
+* @brief        Queues a task at the bottom of a deque, making it larger if it is full
+* @return       0 if success, -1 if there is no memory for it
+*/
+int pool_push(struct pool_deque *deque, struct pool_task task) {
+    pthread_mutex_lock(&(deque->lock));
+    if (deque->bottom-deque->top == deque->capacity) {
+        int capacity = deque->capacity > 0 ? 2*deque->capacity : POOL_DEQUE;
+        struct pool_task *tasks = malloc(capacity*sizeof(struct pool_task));
+        if (tasks == NULL) {
+            pthread_mutex_unlock(&(deque->lock));
+            return -1;
+        }
+        for (int i = deque->top; i < deque->bottom; i++) {
+            tasks[i & (capacity-1)] = deque->tasks[i & (deque->capacity-1)];
+        }
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->capacity = capacity;
+    }
+    deque->tasks[deque->bottom & (deque->capacity-1)] = task;
+    deque->bottom++;
+    pthread_mutex_unlock(&(deque->lock));
+    return 0;
+}
+
+/*
+* @brief        Takes a task from the bottom of the deque of the calling worker or, if there is none, from the top of another one
+* @return       0 if a task was taken, -1 if all the deques are empty
+*/
+int pool_take(struct pool_task *task) {
+    if (atomic_load(&(pool.n_queued)) == 0) {
+        return -1;
+    }
+    for (int i = 0; i < pool.n_workers; i++) {
+        /* Start with its own deque, then go over the rest starting at the next one so that thieves spread out */
+        int w = pool_self >= 0 ? (pool_self+i) % pool.n_workers : i;
+        struct pool_deque *deque = &(pool.deques[w]);
+        pthread_mutex_lock(&(deque->lock));
+        if (deque->top == deque->bottom) {
+            pthread_mutex_unlock(&(deque->lock));
+            continue;
+        }
+        if (w == pool_self) {
+            deque->bottom--;
+            *task = deque->tasks[deque->bottom & (deque->capacity-1)];
+        }
+        else {
+            *task = deque->tasks[deque->top & (deque->capacity-1)];
+            deque->top++;
+        }
+        pthread_mutex_unlock(&(deque->lock));
+        atomic_fetch_sub(&(pool.n_queued), 1);
+        return 0;
+    }
+    return -1;
+}
+
+/*
+* @brief        Runs a task and, if it is the last one of its job, wakes up the thread waiting for it
+*/
+void pool_execute(struct pool_task *task) {
+    struct pool_job *job = task->job;
+    job->task(task->index, job->arg);
+    pthread_mutex_lock(&(job->lock));
+    job->remaining--;
+    if (job->remaining == 0) {
+        pthread_cond_broadcast(&(job->done));
+    }
+    pthread_mutex_unlock(&(job->lock));
+}
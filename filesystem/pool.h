@@ -0,0 +1,27 @@
+
+/*
+ *
+ * Operating System Design / Diseño de Sistemas Operativos
+ * (c) ARCOS.INF.UC3M.ES
+ *
+ * @file 	pool.h
+ * @brief 	Headers for the pool of threads that bulk operations of the file system are spread over.
+ * @date	Last revision 18/10/2026
+ *
+ */
+
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#define POOL_WORKERS 8  // Maximum number of workers of the pool, it has as many as processors up to this number
+#define POOL_DEQUE 64   // Initial number of tasks each worker can have queued, it grows when needed
+
+/*
+ * @brief	Runs task(index, arg) for every index from 0 to n_tasks-1 and waits until all of them are done.
+ * 		The tasks are spread over the workers of the pool, workers that run out of tasks take them from
+ * 		the others, and the caller runs tasks too while it waits. Tasks may run pool_run() themselves.
+ */
+void pool_run(int n_tasks, void (*task)(int index, void *arg), void *arg);
+
+#endif
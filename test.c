@@ -13,7 +13,10 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
 #include "filesystem/filesystem.h"
+#include "filesystem/async.h"
 
 
 // Color definitions for asserts
@@ -27,6 +30,101 @@
 #define N_INODES 48
 #define NAME_LENGTH 32
 
+// Descriptor shared by the threads of the concurrency tests
+int fd_shared;
+
+// File system left mounted to simulate a crash, it is kept here so that it is still reachable
+fs_ctx *crashed_ctx;
+
+// Copy of the whole device image, for the tests that damage it
+char image_backup[N_BLOCKS*BLOCK_SIZE];
+
+// Fills the contents of the shared file for a write, it starts with the number of the write and the rest alternates between two patterns
+void shared_fill(char *buffer, int size, int generation)
+{
+	memcpy(buffer, &generation, sizeof(generation));
+	for (int i = sizeof(generation); i < size; i++) {
+		buffer[i] = generation % 2 == 0 ? i % 127 : 126 - i % 127;
+	}
+}
+
+// Reads the whole shared file many times while another thread writes it, each read has to be the contents of a single write and never older than the previous one
+void *reader_thread(void *arg)
+{
+	char buffer[2*BLOCK_SIZE], expected[2*BLOCK_SIZE];
+	int generation, last = 0;
+	for (int round = 0; round < 200; round++) {
+		if (preadFile(fd_shared, buffer, sizeof(buffer), 0) != sizeof(buffer)) {
+			return (void *) 1;
+		}
+		memcpy(&generation, buffer, sizeof(generation));
+		shared_fill(expected, sizeof(expected), generation);
+		if (generation < last || memcmp(buffer, expected, sizeof(buffer)) != 0) {
+			return (void *) 1;
+		}
+		last = generation;
+	}
+	return NULL;
+}
+
+// Fills the contents of a file of writer_thread, each thread and round has a pattern of its own
+void alloc_fill(char *buffer, int size, long id, int round)
+{
+	for (int i = 0; i < size; i++) {
+		buffer[i] = (char) (id*64+round*3+i/BLOCK_SIZE+i%7);
+	}
+}
+
+// Creates, writes, checks and removes its own file many times while other threads do the same, so their blocks are allocated and freed concurrently.
+// Each file is read back once it is closed and its blocks are on the device, the one of the last round is kept
+void *writer_thread(void *arg)
+{
+	long id = (long) arg;
+	char name[NAME_LENGTH], buffer[2*BLOCK_SIZE], buffer_read[2*BLOCK_SIZE];
+	sprintf(name, "/alloc%ld.txt", id);
+	for (int round = 0; round < 20; round++) {
+		alloc_fill(buffer, sizeof(buffer), id, round);
+		if (createFile(name) < 0) {
+			return (void *) 1;
+		}
+		int fd = openFile(name);
+		int ret = writeFile(fd, buffer, sizeof(buffer)) != sizeof(buffer) || closeFile(fd) != 0;
+		fd = openFile(name);
+		ret |= preadFile(fd, buffer_read, sizeof(buffer), 0) != sizeof(buffer) || memcmp(buffer, buffer_read, sizeof(buffer)) != 0;
+		ret |= closeFile(fd) != 0 || (round < 19 && removeFile(name) != 0);
+		if (ret != 0) {
+			return (void *) 1;
+		}
+	}
+	return NULL;
+}
+
+// Fills a block of a file of claim_thread, it starts with the thread and block it belongs to
+void claim_fill(char *buffer, long id, int block)
+{
+	memset(buffer, (int) ('A'+id), BLOCK_SIZE);
+	sprintf(buffer, "claim %ld block %d", id, block);
+}
+
+// Creates and fills its own file while other threads do the same, even threads preallocate its blocks and odd ones allocate them as they write
+void *claim_thread(void *arg)
+{
+	long id = (long) arg;
+	char name[NAME_LENGTH], buffer[BLOCK_SIZE];
+	sprintf(name, "/claim%ld.txt", id);
+	if (createFile(name) < 0) {
+		return (void *) 1;
+	}
+	int fd = openFile(name);
+	int ret = fd < 0 || (id % 2 == 0 && fallocateFile(fd, 0, MAX_FILE_SIZE) != 0);
+	for (int block = 0; block < MAX_FILE_SIZE/BLOCK_SIZE; block++) {
+		claim_fill(buffer, id, block);
+		ret |= writeFile(fd, buffer, BLOCK_SIZE) != BLOCK_SIZE;
+	}
+	ret |= closeFile(fd) != 0;
+	return ret != 0 ? (void *) 1 : NULL;
+}
+
 int main()
 {
 	int ret;
@@ -157,7 +255,9 @@ int main()
 	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST readFile TP-13 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);  
 
 	/////// Check that reading an empty file returns 0 bytes
-	ret = readFile(1, buffer_read, sizeof(buffer_read)); // Except the first file, the rest of the files are empty
+        int fd_empty = openFile("/file0.txt"); // Except the first file, the rest of the files are empty
+	ret = readFile(fd_empty, buffer_read, sizeof(buffer_read));
+        closeFile(fd_empty);
 	if (ret != 0)
 	{
 		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST readFile TP-14 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
@@ -271,6 +371,7 @@ int main()
         /* Include integrity and open file again without integrity and write something, corrupting the file */
 	ret = includeIntegrity("/file1.txt");
         ret = openFile("/file1.txt");
+        memset(buffer_integrity, 4, sizeof(buffer_integrity));
         writeFile(ret, buffer_integrity, sizeof(buffer_integrity));
         ret = closeFile(ret);
         /* When we open the file with integrity it will be corrupted */
@@ -321,7 +422,7 @@ int main()
 	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST unmountFS TP-28 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
 
         /////// Check that if we reach the limit of the device we cannot write more blocks
-        ret = mkFS(243*BLOCK_SIZE); // As the maximum size of a file is 5 blocks and we can have maximum 48 files they can occupy maximum 240 blocks, so we will create a device where we will be able to fill all files with 5 blocks except 1, which will only have 4 blocks
+        ret = mkFS(259*BLOCK_SIZE); // As the maximum size of a file is 5 blocks and we can have maximum 48 files they can occupy maximum 240 blocks, so we will create a device where we will be able to fill all files with 5 blocks except 1, which will only have 4 blocks (the journal takes 16 of its blocks)
         ret = mountFS();
         
         // Create 48 files and fill them up to their maximum size
@@ -344,6 +445,775 @@ int main()
 
         ret = unmountFS();
 
+        /////// Check that an empty file takes no data block, so it can be created and removed when the device is full
+        ret = mkFS(230*BLOCK_SIZE); // The smallest device has 210 data blocks: 42 files of 5 blocks fill it
+        ret = mountFS();
+        memset(newBuffer, 1, sizeof(newBuffer));
+        for (int i=0; i<42; i++) {
+            sprintf(newfileName, "/full%d.txt", i);
+            ret = createFile(newfileName);
+            ret = openFile(newfileName);
+            writeFile(ret, newBuffer, MAX_FILE_SIZE);
+            closeFile(ret);
+        }
+        int fd_lazy = -1;
+        ret = createFile("/empty.txt");
+        if (ret >= 0) {
+            fd_lazy = openFile("/empty.txt");
+        }
+        if (ret < 0 || fd_lazy < 0 || readFile(fd_lazy, newBuffer, BLOCK_SIZE) != 0 || writeFile(fd_lazy, newBuffer, BLOCK_SIZE) > 0 || closeFile(fd_lazy) != 0 || removeFile("/empty.txt") != 0)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST createFile TP-30 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+        // Once a file is removed its blocks can be given to a file that had none
+        ret = removeFile("/full0.txt");
+        ret = createFile("/empty.txt");
+        fd_lazy = openFile("/empty.txt");
+        if (ret < 0 || writeFile(fd_lazy, newBuffer, MAX_FILE_SIZE) != MAX_FILE_SIZE || closeFile(fd_lazy) != 0)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST createFile TP-30 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST createFile TP-30 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        ret = unmountFS();
+
+        /////// Check that the journal brings back metadata that was committed but never reached its place on the disk
+        char device_replay[] = "disk.dat";
+        char buffer_replay[] = "replayed contents";
+        char buffer_replay_read[BLOCK_SIZE];
+        ret = mkFS(DEV_SIZE);
+        crashed_ctx = ctx_mountFS(device_replay);
+        ret = crashed_ctx == NULL || ctx_createFile(crashed_ctx, "/replay.txt") < 0;
+        int fd_replay = ctx_openFile(crashed_ctx, "/replay.txt");
+        ret |= ctx_writeFile(crashed_ctx, fd_replay, buffer_replay, sizeof(buffer_replay)) != sizeof(buffer_replay) || ctx_fs_sync(crashed_ctx) != 0;
+        // The inode block of the file is lost as if the machine stopped before writing it, and the context is dropped without unmounting it
+        int found_replay = 0;
+        for (int b = 1; b <= N_INODES/16 && bread(device_replay, b, buffer_replay_read) == 0; b++) {
+                for (int i = 0; i+10 <= BLOCK_SIZE && found_replay == 0; i++) {
+                        found_replay = memcmp(buffer_replay_read+i, "replay.txt", 10) == 0;
+                }
+                if (found_replay) {
+                        memset(buffer_replay_read, 0, BLOCK_SIZE);
+                        ret |= bwrite(device_replay, b, buffer_replay_read) != 0;
+                        break;
+                }
+        }
+        ret |= found_replay == 0 || mountFS() != 0;
+        fd_replay = openFile("/replay.txt");
+        if (ret != 0 || fd_replay < 0 || readFile(fd_replay, buffer_replay_read, BLOCK_SIZE) != sizeof(buffer_replay) || memcmp(buffer_replay, buffer_replay_read, sizeof(buffer_replay)) != 0 || closeFile(fd_replay) != 0)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST mountFS TP-31 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST mountFS TP-31 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        ret = unmountFS();
+
+        /////// Small files are stored inline in the inode and persist between mounts
+        ret = mkFS(DEV_SIZE);
+        ret = mountFS();
+        char buffer_inline[] = "inline contents";
+        char buffer_inline_read[sizeof(buffer_inline)];
+        ret = createFile("/small.txt");
+        ret = openFile("/small.txt");
+        ret = writeFile(ret, buffer_inline, sizeof(buffer_inline));
+        ret = unmountFS();
+        ret = mountFS();
+        ret = openFile("/small.txt");
+        ret = readFile(ret, buffer_inline_read, sizeof(buffer_inline_read));
+	if (ret != sizeof(buffer_inline) || memcmp(buffer_inline, buffer_inline_read, sizeof(buffer_inline)) != 0)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST TP-32 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST TP-32 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        /////// Correct functionality of fallocateFile, the preallocated range can then be written completely
+        ret = createFile("/prealloc.txt");
+        int fd_prealloc = openFile("/prealloc.txt");
+        ret = fallocateFile(fd_prealloc, 0, MAX_FILE_SIZE);
+        if (ret != 0 || writeFile(fd_prealloc, buffer_maximum, MAX_FILE_SIZE) != MAX_FILE_SIZE)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST fallocateFile TP-33 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST fallocateFile TP-33 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        /////// Check that we cannot preallocate beyond the maximum size of a file
+        ret = fallocateFile(fd_prealloc, 0, MAX_FILE_SIZE + 1);
+        if (ret != -1)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST fallocateFile TP-34 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST fallocateFile TP-34 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+        ret = closeFile(fd_prealloc);
+
+        /////// Check that a preallocation that fails partway leaves the file and the free space as they were
+        char buffer_undo[2*BLOCK_SIZE];
+        char buffer_undo_read[2*BLOCK_SIZE];
+        memset(buffer_undo, 'u', sizeof(buffer_undo));
+        ret = ctx_mkFS("disk_falloc.dat", 230*BLOCK_SIZE); // 210 data blocks, 42 files of 5 blocks fill them
+        fs_ctx *ctx_undo = ctx_mountFS("disk_falloc.dat");
+        ret |= ctx_undo == NULL || ctx_createFile(ctx_undo, "/undo.txt") < 0;
+        int fd_undo = ctx_openFile(ctx_undo, "/undo.txt");
+        ret |= ctx_writeFile(ctx_undo, fd_undo, buffer_undo, sizeof(buffer_undo)) != sizeof(buffer_undo);
+        // The data blocks are cut from the device, so the delayed data can't be written to the blocks being preallocated
+        FILE *image_undo = fopen("disk_falloc.dat", "r+");
+        ret |= fread(image_backup, 1, 230*BLOCK_SIZE, image_undo) != 230*BLOCK_SIZE || ftruncate(fileno(image_undo), 4*BLOCK_SIZE) != 0;
+        ret |= ctx_fallocateFile(ctx_undo, fd_undo, 0, MAX_FILE_SIZE) != -1;
+        ret |= fseek(image_undo, 0, SEEK_SET) != 0 || fwrite(image_backup, 1, 230*BLOCK_SIZE, image_undo) != 230*BLOCK_SIZE;
+        fclose(image_undo);
+        // The data is still there and the whole range can be preallocated once the device is back
+        ret |= ctx_preadFile(ctx_undo, fd_undo, buffer_undo_read, sizeof(buffer_undo_read), 0) != sizeof(buffer_undo) || memcmp(buffer_undo, buffer_undo_read, sizeof(buffer_undo)) != 0;
+        ret |= ctx_fallocateFile(ctx_undo, fd_undo, 0, MAX_FILE_SIZE) != 0 || ctx_closeFile(ctx_undo, fd_undo) != 0 || ctx_fs_sync(ctx_undo) != 0;
+        // Every other block is free: 41 more files fill the device and nothing is left after them
+        for (int i = 0; i <= 41 && ret == 0; i++) {
+                sprintf(newfileName, "/undo%d.txt", i);
+                ret |= ctx_createFile(ctx_undo, newfileName) < 0;
+                fd_undo = ctx_openFile(ctx_undo, newfileName);
+                int written_undo = ctx_writeFile(ctx_undo, fd_undo, newBuffer, MAX_FILE_SIZE);
+                ret |= i < 41 ? written_undo != MAX_FILE_SIZE : written_undo > 0;
+                ret |= ctx_closeFile(ctx_undo, fd_undo) != 0;
+        }
+        ret |= ctx_unmountFS(ctx_undo) != 0;
+        remove("disk_falloc.dat");
+        if (ret != 0)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST fallocateFile TP-35 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST fallocateFile TP-35 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        /////// Correct functionality of mkDir, files can be created and opened inside a directory
+        ret = mkDir("/dir");
+        if (ret != 0 || createFile("/dir/nested.txt") < 0 || openFile("/dir/nested.txt") < 0)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST mkDir TP-36 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST mkDir TP-36 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        /////// Check that a directory can only be removed when it is empty
+        ret = rmDir("/dir");
+        if (ret != -2 || removeFile("/dir/nested.txt") != 0 || rmDir("/dir") != 0 || openFile("/dir/nested.txt") != -1)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST rmDir TP-37 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST rmDir TP-37 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        /////// Check that files are not lost when there are more of them than inodes kept in memory
+        char name_many[NAME_LENGTH];
+        char buffer_many[NAME_LENGTH];
+        int fails_many = 0;
+        for (int i = 0; i < 40; i++) {
+                sprintf(name_many, "/many%d", i);
+                createFile(name_many);
+                ret = openFile(name_many);
+                writeFile(ret, name_many, NAME_LENGTH);
+                closeFile(ret);
+        }
+        for (int i = 0; i < 40; i++) {
+                sprintf(name_many, "/many%d", i);
+                ret = openFile(name_many);
+                if (ret < 0 || readFile(ret, buffer_many, NAME_LENGTH) != NAME_LENGTH || strcmp(buffer_many, name_many) != 0) {
+                        fails_many++;
+                }
+                closeFile(ret);
+                removeFile(name_many);
+        }
+        if (fails_many != 0)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST TP-38 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST TP-38 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        /////// Check that removing a file removes the links left pointing to it
+        ret = createFile("/target.txt");
+        ret = createLn("/target.txt", "/ln1");
+        ret = createLn("/target.txt", "/ln2");
+        ret = createLn("/target.txt", "/ln3");
+        if (removeLn("/ln2") != 0 || removeFile("/target.txt") != 0 || openFile("/ln1") != -1 || openFile("/ln3") != -1)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST removeFile TP-39 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST removeFile TP-39 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        /////// Correct functionality of createHardLn, the file stays until its last name is removed
+        char buffer_hard[] = "hard link contents";
+        char buffer_hard_read[sizeof(buffer_hard)];
+        ret = createFile("/original.txt");
+        ret = openFile("/original.txt");
+        ret = writeFile(ret, buffer_hard, sizeof(buffer_hard));
+        ret = closeFile(ret);
+        ret = createHardLn("/original.txt", "/alias.txt");
+        if (ret != 0 || removeFile("/original.txt") != 0 || openFile("/original.txt") != -1)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST createHardLn TP-40 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+        ret = openFile("/alias.txt");
+        if (ret < 0 || readFile(ret, buffer_hard_read, sizeof(buffer_hard)) != sizeof(buffer_hard) || memcmp(buffer_hard, buffer_hard_read, sizeof(buffer_hard)) != 0)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST createHardLn TP-40 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+        ret = closeFile(ret);
+        if (removeFile("/alias.txt") != 0 || openFile("/alias.txt") != -1)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST createHardLn TP-40 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST createHardLn TP-40 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        /////// Check that two descriptors of the same file have their own seek pointer
+        char buffer_twice[] = "independent descriptors";
+        char buffer_twice_read[sizeof(buffer_twice)];
+        ret = createFile("/twice.txt");
+        int fd_writer = openFile("/twice.txt");
+        int fd_reader = openFile("/twice.txt");
+        ret = writeFile(fd_writer, buffer_twice, sizeof(buffer_twice));
+        if (fd_writer == fd_reader || readFile(fd_reader, buffer_twice_read, sizeof(buffer_twice)) != sizeof(buffer_twice) || memcmp(buffer_twice, buffer_twice_read, sizeof(buffer_twice)) != 0 || readFile(fd_writer, buffer_twice_read, 1) != 0)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST openFile TP-41 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST openFile TP-41 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+        ret = closeFile(fd_writer);
+        ret = closeFile(fd_reader);
+
+        /////// Correct functionality of preadFile and pwriteFile, the seek pointer doesn't move
+        char buffer_pos[2*BLOCK_SIZE];
+        char buffer_pos_read[2*BLOCK_SIZE];
+        for (int i = 0; i < (int) sizeof(buffer_pos); i++) {
+                buffer_pos[i] = i % 251;
+        }
+        ret = createFile("/positional.txt");
+        int fd_pos = openFile("/positional.txt");
+        ret = pwriteFile(fd_pos, buffer_pos, sizeof(buffer_pos), 100);
+        if (ret != sizeof(buffer_pos) || preadFile(fd_pos, buffer_pos_read, sizeof(buffer_pos), 100) != sizeof(buffer_pos) || memcmp(buffer_pos, buffer_pos_read, sizeof(buffer_pos)) != 0 || readFile(fd_pos, buffer_pos_read, 100) != 100 || lseekFile(fd_pos, 0, FS_SEEK_END) != 0 || readFile(fd_pos, buffer_pos_read, 1) != 0)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST pwriteFile TP-42 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST pwriteFile TP-42 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        /////// Check that writing over existing data doesn't make the file larger, and that a negative size writes nothing
+        ret = pwriteFile(fd_pos, buffer_pos, BLOCK_SIZE, 0);
+        ret = lseekFile(fd_pos, 0, FS_SEEK_END);
+        if (ret != 0 || writeFile(fd_pos, buffer_pos, -1) != -1 || lseekFile(fd_pos, 0, FS_SEEK_CUR) != 0 || preadFile(fd_pos, buffer_pos_read, sizeof(buffer_pos_read), 100) != sizeof(buffer_pos) || preadFile(fd_pos, buffer_pos_read, 1, 100+sizeof(buffer_pos)) != 0)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST pwriteFile TP-43 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST pwriteFile TP-43 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+        ret = closeFile(fd_pos);
+
+        /////// Correct functionality of writevFile and readvFile, pieces of a record are written and read together
+        char header_vec[] = "header:";
+        char payload_vec[3000];
+        memset(payload_vec, 5, sizeof(payload_vec));
+        char header_vec_read[sizeof(header_vec)];
+        char payload_vec_read[sizeof(payload_vec)];
+        struct iovec iov_write[2] = { { header_vec, sizeof(header_vec) }, { payload_vec, sizeof(payload_vec) } };
+        struct iovec iov_read[2] = { { header_vec_read, sizeof(header_vec_read) }, { payload_vec_read, sizeof(payload_vec_read) } };
+        ret = createFile("/records.txt");
+        int fd_vec = openFile("/records.txt");
+        ret = writevFile(fd_vec, iov_write, 2);
+        if (ret != sizeof(header_vec)+sizeof(payload_vec) || lseekFile(fd_vec, 0, FS_SEEK_BEGIN) != 0 || readvFile(fd_vec, iov_read, 2) != ret || memcmp(header_vec, header_vec_read, sizeof(header_vec)) != 0 || memcmp(payload_vec, payload_vec_read, sizeof(payload_vec)) != 0)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST writevFile TP-44 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+        /* Once the file is in the disk, a region over three of its blocks is written and read with a single request */
+        char buffer_extent[3*BLOCK_SIZE];
+        char buffer_extent_read[3*BLOCK_SIZE];
+        memset(buffer_extent, 6, sizeof(buffer_extent));
+        int size_vec = sizeof(header_vec)+sizeof(payload_vec);
+        ret = lseekFile(fd_vec, 0, FS_SEEK_END) | (writeFile(fd_vec, buffer_extent, 3*BLOCK_SIZE-size_vec) != 3*BLOCK_SIZE-size_vec);
+        ret |= closeFile(fd_vec) | fs_sync();
+        for (int i = 0; i < (int) sizeof(buffer_extent); i++) {
+                buffer_extent[i] = i % 241;
+        }
+        struct iovec iov_extent[2] = { { buffer_extent, BLOCK_SIZE }, { buffer_extent+BLOCK_SIZE, 2*BLOCK_SIZE-200 } };
+        fd_vec = openFile("/records.txt");
+        ret |= lseekFile(fd_vec, 100, FS_SEEK_CUR) | (writevFile(fd_vec, iov_extent, 2) != 3*BLOCK_SIZE-200);
+        ret |= closeFile(fd_vec) | fs_sync() | unmountFS() | mountFS();
+        fd_vec = openFile("/records.txt");
+        struct iovec iov_extent_read[2] = { { buffer_extent_read, 100 }, { buffer_extent_read+100, 3*BLOCK_SIZE-100 } };
+        ret |= readvFile(fd_vec, iov_extent_read, 2) != 3*BLOCK_SIZE;
+        if (ret != 0 || memcmp(buffer_extent_read, header_vec, sizeof(header_vec)) != 0 || memcmp(buffer_extent_read+100, buffer_extent, 3*BLOCK_SIZE-200) != 0 || buffer_extent_read[3*BLOCK_SIZE-100] != 6 || buffer_extent_read[3*BLOCK_SIZE-1] != 6)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST writevFile TP-44 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST writevFile TP-44 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+        ret = closeFile(fd_vec);
+
+        /////// Check that several threads can read the same file at once
+        char buffer_shared[2*BLOCK_SIZE];
+        shared_fill(buffer_shared, sizeof(buffer_shared), 0);
+        ret = createFile("/shared.txt");
+        fd_shared = openFile("/shared.txt");
+        ret = writeFile(fd_shared, buffer_shared, sizeof(buffer_shared));
+        fs_sync();
+        pthread_t readers[4];
+        void *reader_ret;
+        int failed = 0;
+        for (int i = 0; i < 4; i++) {
+                pthread_create(&readers[i], NULL, reader_thread, NULL);
+        }
+        // Meanwhile the file is written again with the other pattern each time, so the readers have to retry or wait to see a whole write
+        for (int i = 1; i <= 400; i++) {
+                shared_fill(buffer_shared, sizeof(buffer_shared), i);
+                failed |= pwriteFile(fd_shared, buffer_shared, sizeof(buffer_shared), 0) != sizeof(buffer_shared);
+        }
+        for (int i = 0; i < 4; i++) {
+                pthread_join(readers[i], &reader_ret);
+                failed |= reader_ret != NULL;
+        }
+        if (ret != sizeof(buffer_shared) || failed)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST preadFile TP-45 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST preadFile TP-45 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+        ret = closeFile(fd_shared);
+
+        /////// Check that a second device image can be used at the same time, without seeing the files of the first one
+        char buffer_ctx[] = "contents of the second device";
+        char buffer_ctx_read[sizeof(buffer_ctx)];
+        ret = ctx_mkFS("disk_ctx.dat", DEV_SIZE);
+        fs_ctx *ctx = ctx_mountFS("disk_ctx.dat");
+        if (ret != 0 || ctx == NULL)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST ctx_mountFS TP-46 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+        ret = ctx_createFile(ctx, "/ctx.txt");
+        int fd_ctx = ctx_openFile(ctx, "/ctx.txt");
+        if (ret < 0 || fd_ctx < 0 || ctx_writeFile(ctx, fd_ctx, buffer_ctx, sizeof(buffer_ctx)) != sizeof(buffer_ctx) || ctx_preadFile(ctx, fd_ctx, buffer_ctx_read, sizeof(buffer_ctx), 0) != sizeof(buffer_ctx) || memcmp(buffer_ctx, buffer_ctx_read, sizeof(buffer_ctx)) != 0 || openFile("/ctx.txt") != -1 || ctx_openFile(ctx, "/shared.txt") != -1)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST ctx_mountFS TP-46 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST ctx_mountFS TP-46 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+        ret = ctx_closeFile(ctx, fd_ctx);
+        ret = ctx_unmountFS(ctx);
+        remove("disk_ctx.dat");
+        // Making the file system of the second device leaves the first one as it was
+        char buffer_shared_read[sizeof(buffer_shared)];
+        ret |= unmountFS() | mountFS();
+        fd_shared = openFile("/shared.txt");
+        if (ret != 0 || readFile(fd_shared, buffer_shared_read, sizeof(buffer_shared)) != sizeof(buffer_shared) || memcmp(buffer_shared, buffer_shared_read, sizeof(buffer_shared)) != 0 || closeFile(fd_shared) != 0)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST ctx_mkFS TP-46 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+
+        /////// Correct functionality of the asynchronous interface, the writes of a file are reaped and then read back
+        fs_queue *queue = async_create(2);
+        struct fs_request req_async[4];
+        char buffer_async[4][BLOCK_SIZE];
+        char buffer_async_read[4][BLOCK_SIZE];
+        memset(req_async, 0, sizeof(req_async));
+        req_async[0].op = ASYNC_CREATE;
+        req_async[0].path = "/async.txt";
+        ret = async_submit(queue, &req_async[0]);
+        ret = async_wait(queue) == &req_async[0] && req_async[0].result >= 0 ? 0 : -1;
+        req_async[0].op = ASYNC_OPEN;
+        ret |= async_submit(queue, &req_async[0]);
+        int fd_async = async_wait(queue)->result;
+        for (int i = 3; i >= 0; i--) {
+                memset(buffer_async[i], i+1, BLOCK_SIZE);
+                struct fs_request write_req = { .op = ASYNC_WRITE, .fd = fd_async, .buffer = buffer_async[i], .numBytes = BLOCK_SIZE, .offset = i*BLOCK_SIZE };
+                req_async[i] = write_req;
+                ret |= async_submit(queue, &req_async[i]);
+        }
+        for (int i = 0; i < 4; i++) {
+                ret |= async_wait(queue)->result != BLOCK_SIZE;
+        }
+        for (int i = 0; i < 4; i++) {
+                struct fs_request read_req = { .op = ASYNC_READ, .fd = fd_async, .buffer = buffer_async_read[i], .numBytes = BLOCK_SIZE, .offset = i*BLOCK_SIZE };
+                req_async[i] = read_req;
+                ret |= async_submit(queue, &req_async[i]);
+        }
+        eventfd_t completions = 0;
+        for (int i = 0; i < 4; i++) {
+                ret |= async_wait(queue)->result != BLOCK_SIZE;
+        }
+        if (ret != 0 || fd_async < 0 || memcmp(buffer_async, buffer_async_read, sizeof(buffer_async)) != 0 || async_poll(queue) != NULL || eventfd_read(async_eventfd(queue), &completions) != -1)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST async_submit TP-47 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST async_submit TP-47 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        /////// Correct functionality of the asynchronous interface, a create and an open submitted after some writes without waiting
+        /////// are done after them and in order, even though the open goes in the next batch
+        struct fs_request req_order[17];
+        char buffer_order[15][64];
+        memset(req_order, 0, sizeof(req_order));
+        for (int i = 0; i < 15; i++) {
+                memset(buffer_order[i], 'a'+i, sizeof(buffer_order[i]));
+                struct fs_request write_req = { .op = ASYNC_WRITE, .fd = fd_async, .buffer = buffer_order[i], .numBytes = sizeof(buffer_order[i]), .offset = i*sizeof(buffer_order[i]) };
+                req_order[i] = write_req;
+        }
+        req_order[15].op = ASYNC_CREATE;
+        req_order[15].path = "/async_order.txt";
+        req_order[16].op = ASYNC_OPEN;
+        req_order[16].path = "/async_order.txt";
+        ret = 0;
+        for (int i = 0; i < 17; i++) {
+                ret |= async_submit(queue, &req_order[i]);
+        }
+        // The writes complete in any order, but all of them before the create and the create before the open
+        for (int i = 0; i < 17; i++) {
+                struct fs_request *done = async_wait(queue);
+                ret |= i < 15 ? done->op != ASYNC_WRITE || done->result != sizeof(buffer_order[0]) : done != &req_order[i] || done->result < 0;
+        }
+        char buffer_order_read[sizeof(buffer_order)];
+        ret |= preadFile(fd_async, buffer_order_read, sizeof(buffer_order_read), 0) != sizeof(buffer_order_read);
+        if (ret != 0 || memcmp(buffer_order, buffer_order_read, sizeof(buffer_order)) != 0 || closeFile(req_order[16].result) != 0)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST async_submit TP-47 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST async_submit TP-47 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+        ret = closeFile(fd_async);
+        ret = async_destroy(queue);
+
+        /////// Correct functionality of checkAllFiles, the files with integrity are checked in parallel and none is corrupted
+        ret = includeIntegrity("/async.txt");
+        if (ret != 0 || checkAllFiles() != 0)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST checkAllFiles TP-48 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST checkAllFiles TP-48 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        /////// Correct functionality of checkAllFiles, a byte of the file is changed on the device behind the file system and the file is reported as corrupted
+        char device_check[] = "disk.dat";
+        char buffer_check[BLOCK_SIZE], buffer_check_read[BLOCK_SIZE];
+        memcpy(buffer_check, buffer_order, sizeof(buffer_order));
+        memcpy(buffer_check+sizeof(buffer_order), buffer_async[0]+sizeof(buffer_order), BLOCK_SIZE-sizeof(buffer_order));
+        int block_check = -1;
+        ret = fs_sync();
+        for (int b = 0; b < N_BLOCKS && block_check == -1; b++) {
+                if (bread(device_check, b, buffer_check_read) == 0 && memcmp(buffer_check, buffer_check_read, BLOCK_SIZE) == 0) {
+                        block_check = b;
+                }
+        }
+        buffer_check_read[BLOCK_SIZE/2] ^= 1;
+        ret |= block_check == -1 || bwrite(device_check, block_check, buffer_check_read) != 0;
+        int corrupted = checkAllFiles();
+        // The file is left as it was for the tests that follow
+        ret |= block_check == -1 || bwrite(device_check, block_check, buffer_check) != 0;
+        if (ret != 0 || corrupted != 1 || checkAllFiles() != 0)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST checkAllFiles TP-48 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST checkAllFiles TP-48 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        /////// Correct functionality of the allocation caches, threads allocating and freeing blocks at the same time never get the same block
+        pthread_t writers[4];
+        ret = 0;
+        for (long i = 0; i < 4; i++) {
+                ret |= pthread_create(&writers[i], NULL, writer_thread, (void *) i);
+        }
+        for (int i = 0; i < 4; i++) {
+                void *writer_ret;
+                pthread_join(writers[i], &writer_ret);
+                ret |= writer_ret != NULL;
+        }
+        // Once everything is on the device, no file has been overwritten by another one
+        ret |= fs_sync();
+        for (long i = 0; i < 4; i++) {
+                char name_alloc[NAME_LENGTH], buffer_alloc[2*BLOCK_SIZE], buffer_alloc_read[2*BLOCK_SIZE];
+                sprintf(name_alloc, "/alloc%ld.txt", i);
+                alloc_fill(buffer_alloc, sizeof(buffer_alloc), i, 19);
+                int fd_alloc = openFile(name_alloc);
+                ret |= readFile(fd_alloc, buffer_alloc_read, sizeof(buffer_alloc_read)) != sizeof(buffer_alloc_read) || memcmp(buffer_alloc, buffer_alloc_read, sizeof(buffer_alloc)) != 0;
+                ret |= closeFile(fd_alloc) != 0;
+        }
+        for (long i = 0; i < 4; i++) {
+                char name_alloc[NAME_LENGTH];
+                sprintf(name_alloc, "/alloc%ld.txt", i);
+                ret |= removeFile(name_alloc) != 0;
+        }
+        if (ret != 0 || checkAllFiles() != 0)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST balloc TP-49 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST balloc TP-49 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        /////// Check that the blocks of two files written at the same time are each placed contiguously once they are closed
+        char device_contig[] = "disk.dat";
+        char buffer_contig[BLOCK_SIZE];
+        char buffer_contig_read[BLOCK_SIZE];
+        int fd_contig[2], block_contig[2][4];
+        ret = createFile("/contig0.txt");
+        ret = createFile("/contig1.txt");
+        fd_contig[0] = openFile("/contig0.txt");
+        fd_contig[1] = openFile("/contig1.txt");
+        // The blocks of the files are written alternately, each one with contents that identify it on the device
+        for (int i = 0; i < 4; i++) {
+                for (int f = 0; f < 2; f++) {
+                        memset(buffer_contig, 'a'+f, BLOCK_SIZE);
+                        sprintf(buffer_contig, "contiguous file %d block %d", f, i);
+                        writeFile(fd_contig[f], buffer_contig, BLOCK_SIZE);
+                }
+        }
+        ret = closeFile(fd_contig[0]) | closeFile(fd_contig[1]) | fs_sync();
+        for (int f = 0; f < 2; f++) {
+                for (int i = 0; i < 4; i++) {
+                        memset(buffer_contig, 'a'+f, BLOCK_SIZE);
+                        sprintf(buffer_contig, "contiguous file %d block %d", f, i);
+                        block_contig[f][i] = -1;
+                        for (int b = 0; b < N_BLOCKS && block_contig[f][i] == -1; b++) {
+                                if (bread(device_contig, b, buffer_contig_read) == 0 && memcmp(buffer_contig, buffer_contig_read, BLOCK_SIZE) == 0) {
+                                        block_contig[f][i] = b;
+                                }
+                        }
+                        ret |= block_contig[f][i] == -1 || block_contig[f][i] != block_contig[f][0]+i;
+                }
+        }
+        if (ret != 0 || removeFile("/contig0.txt") != 0 || removeFile("/contig1.txt") != 0)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST closeFile TP-50 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST closeFile TP-50 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        /////// Check that names are found through the index after mounting again, a name in two directories resolves to two files and a directory is empty once its last entry goes
+        char name_index[NAME_LENGTH];
+        char buffer_index[] = "x in /x/same.txt";
+        ret = mkDir("/ia") | mkDir("/ib");
+        for (int d = 0; d < 2; d++) {
+                sprintf(name_index, "/i%c/same.txt", 'a'+d);
+                buffer_index[0] = 'a'+d;
+                buffer_index[6] = 'a'+d;
+                ret |= createFile(name_index) < 0;
+                int fd_index = openFile(name_index);
+                ret |= writeFile(fd_index, buffer_index, sizeof(buffer_index)) != sizeof(buffer_index) || closeFile(fd_index) != 0;
+        }
+        for (int i = 0; i < 20; i++) {
+                sprintf(name_index, "/ia/f%d", i);
+                ret |= createFile(name_index) < 0;
+        }
+        ret |= unmountFS() | mountFS();
+        for (int d = 0; d < 2; d++) {
+                char buffer_index_read[sizeof(buffer_index)];
+                sprintf(name_index, "/i%c/same.txt", 'a'+d);
+                int fd_index = openFile(name_index);
+                ret |= fd_index < 0 || readFile(fd_index, buffer_index_read, sizeof(buffer_index)) != sizeof(buffer_index) || buffer_index_read[0] != 'a'+d || buffer_index_read[6] != 'a'+d;
+                ret |= closeFile(fd_index) != 0 || removeFile(name_index) != 0;
+        }
+        for (int i = 0; i < 20; i++) {
+                sprintf(name_index, "/ia/f%d", i);
+                int fd_index = openFile(name_index);
+                ret |= fd_index < 0 || closeFile(fd_index) != 0;
+        }
+        ret |= openFile("/ia/f20") != -1 || openFile("/ib/f0") != -1;
+        // The directory counts its entries, it can only be removed after the last one, also when the count was read from the disk
+        for (int i = 0; i < 20; i++) {
+                ret |= rmDir("/ia") != -2;
+                sprintf(name_index, "/ia/f%d", i);
+                ret |= removeFile(name_index) != 0;
+                if (i == 10) {
+                        ret |= unmountFS() | mountFS();
+                }
+        }
+        if (ret != 0 || rmDir("/ia") != 0 || rmDir("/ib") != 0)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST mountFS TP-51 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST mountFS TP-51 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        /////// Check that the filter of names never hides an existing file, after removing names that share its counters and after mounting again
+        char name_bloom[NAME_LENGTH];
+        ret = 0;
+        for (int i = 0; i < 30; i++) {
+                sprintf(name_bloom, "/bloom%d", i);
+                ret |= createFile(name_bloom) < 0;
+        }
+        // Only the odd names are left, the counters of the even ones are taken back
+        for (int i = 0; i < 30; i += 2) {
+                sprintf(name_bloom, "/bloom%d", i);
+                ret |= removeFile(name_bloom) != 0;
+        }
+        for (int round = 0; round < 2; round++) {
+                for (int i = 0; i < 30; i++) {
+                        sprintf(name_bloom, "/bloom%d", i);
+                        int fd_bloom = openFile(name_bloom);
+                        ret |= i % 2 == 0 ? fd_bloom != -1 : fd_bloom < 0 || closeFile(fd_bloom) != 0 || createFile(name_bloom) != -1;
+                }
+                // The filter isn't stored, it is built again from the names on the disk
+                ret |= unmountFS() | mountFS();
+        }
+        for (int i = 1; i < 30; i += 2) {
+                sprintf(name_bloom, "/bloom%d", i);
+                ret |= removeFile(name_bloom) != 0;
+        }
+        if (ret != 0 || openFile("/bloom1") != -1)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST openFile TP-52 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST openFile TP-52 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        /////// Check that an inode that can't be read from the device is not kept in memory, so it is found once the device can be read again
+        char name_unread[NAME_LENGTH];
+        char buffer_unread[] = "inode read later";
+        char buffer_unread_read[sizeof(buffer_unread)];
+        int inode_unread = -1, n_unread = 0;
+        // Files are created until one of them has its inode outside the inode block read when mounting
+        while (inode_unread < 16 && n_unread < N_INODES) {
+                sprintf(name_unread, "/unread%d", n_unread++);
+                inode_unread = createFile(name_unread);
+        }
+        int fd_unread = openFile(name_unread);
+        ret = writeFile(fd_unread, buffer_unread, sizeof(buffer_unread)) != sizeof(buffer_unread) || closeFile(fd_unread) != 0;
+        ret |= unmountFS() | mountFS();
+        // The device is cut short so that the inode can't be read, then its contents are put back
+        FILE *image_unread = fopen("disk.dat", "r+");
+        ret |= fread(image_backup, 1, sizeof(image_backup), image_unread) != sizeof(image_backup) || ftruncate(fileno(image_unread), 2*BLOCK_SIZE) != 0;
+        fd_unread = openFile(name_unread);
+        ret |= fseek(image_unread, 0, SEEK_SET) != 0 || fwrite(image_backup, 1, sizeof(image_backup), image_unread) != sizeof(image_backup);
+        fclose(image_unread);
+        ret |= fd_unread != -1;
+        fd_unread = openFile(name_unread);
+        ret |= fd_unread < 0 || readFile(fd_unread, buffer_unread_read, sizeof(buffer_unread)) != sizeof(buffer_unread) || memcmp(buffer_unread, buffer_unread_read, sizeof(buffer_unread)) != 0 || closeFile(fd_unread) != 0;
+        for (int i = 0; i < n_unread; i++) {
+                sprintf(name_unread, "/unread%d", i);
+                ret |= removeFile(name_unread) != 0;
+        }
+        if (ret != 0 || inode_unread < 16)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST openFile TP-53 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST openFile TP-53 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        /////// Check that the type, target and size used to resolve names stay right after mounting again and when an inode is used for something else
+        char buffer_hot[] = "hot fields";
+        char buffer_hot_read[sizeof(buffer_hot)];
+        ret = mkDir("/hot") != 0 || createFile("/hot/f") < 0 || createLn("/hot/f", "/hotln") != 0 || createHardLn("/hot/f", "/hothard") != 0;
+        int fd_hot = openFile("/hot/f");
+        ret |= writeFile(fd_hot, buffer_hot, sizeof(buffer_hot)) != sizeof(buffer_hot) || closeFile(fd_hot) != 0;
+        ret |= unmountFS() | mountFS();
+        // A directory can't be opened, linked or removed while it has an entry, and a file is not a symbolic link
+        ret |= openFile("/hot") != -2 || createLn("/hot", "/hotdir") != -2 || rmDir("/hot") != -2 || removeLn("/hot/f") == 0;
+        // Both kinds of links resolve to the file
+        for (int i = 0; i < 2; i++) {
+                fd_hot = openFile(i == 0 ? "/hotln" : "/hothard");
+                ret |= fd_hot < 0 || readFile(fd_hot, buffer_hot_read, sizeof(buffer_hot)) != sizeof(buffer_hot) || memcmp(buffer_hot, buffer_hot_read, sizeof(buffer_hot)) != 0 || closeFile(fd_hot) != 0;
+        }
+        // The inode of the symbolic link can be used by a directory
+        ret |= removeLn("/hotln") != 0 || mkDir("/hotln") != 0 || openFile("/hotln") != -2 || createFile("/hotln/g") < 0 || rmDir("/hotln") != -2;
+        ret |= removeFile("/hotln/g") != 0 || rmDir("/hotln") != 0 || removeFile("/hothard") != 0 || removeFile("/hot/f") != 0;
+        if (ret != 0 || rmDir("/hot") != 0)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST mountFS TP-54 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST mountFS TP-54 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        /////// Correct functionality of fs_sync, the data of a file still open and its inode are on the device afterwards
+        char buffer_sync[BLOCK_SIZE];
+        char buffer_sync_read[BLOCK_SIZE];
+        memset(buffer_sync, 's', BLOCK_SIZE);
+        sprintf(buffer_sync, "synchronized block");
+        ret = createFile("/synced.txt");
+        int fd_sync = openFile("/synced.txt");
+        ret = writeFile(fd_sync, buffer_sync, BLOCK_SIZE);
+        ret = fs_sync();
+        int found_data = 0, found_inode = 0;
+        for (int b = 0; b < N_BLOCKS && bread(device_contig, b, buffer_sync_read) == 0; b++) {
+                found_data |= memcmp(buffer_sync, buffer_sync_read, BLOCK_SIZE) == 0;
+                // The inodes are in the blocks that follow the superblock
+                for (int i = 0; b >= 1 && b <= N_INODES/16 && i+10 <= BLOCK_SIZE; i++) {
+                        found_inode |= memcmp(buffer_sync_read+i, "synced.txt", 10) == 0;
+                }
+        }
+        if (ret != 0 || found_data == 0 || found_inode == 0 || closeFile(fd_sync) != 0)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST fs_sync TP-55 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST fs_sync TP-55 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        /////// Check that threads claiming blocks from the map at the same time never get the same block
+        pthread_t claimers[8];
+        int block_claim[8][MAX_FILE_SIZE/BLOCK_SIZE];
+        char buffer_claim[BLOCK_SIZE], buffer_claim_read[BLOCK_SIZE];
+        memset(block_claim, -1, sizeof(block_claim));
+        ret = 0;
+        for (long i = 0; i < 8; i++) {
+                ret |= pthread_create(&claimers[i], NULL, claim_thread, (void *) i);
+        }
+        for (int i = 0; i < 8; i++) {
+                void *claim_ret;
+                pthread_join(claimers[i], &claim_ret);
+                ret |= claim_ret != NULL;
+        }
+        ret |= fs_sync() != 0;
+        // Each block of each file is found on the device once, which it couldn't be if two files had been given the same block
+        for (int b = 0; b < N_BLOCKS && bread(device_contig, b, buffer_claim_read) == 0; b++) {
+                long id;
+                int block;
+                if (sscanf(buffer_claim_read, "claim %ld block %d", &id, &block) != 2 || id < 0 || id >= 8 || block < 0 || block >= MAX_FILE_SIZE/BLOCK_SIZE) {
+                        continue;
+                }
+                claim_fill(buffer_claim, id, block);
+                if (memcmp(buffer_claim, buffer_claim_read, BLOCK_SIZE) == 0) {
+                        ret |= block_claim[id][block] != -1;
+                        block_claim[id][block] = b;
+                }
+        }
+        for (long i = 0; i < 8; i++) {
+                char name_claim[NAME_LENGTH];
+                sprintf(name_claim, "/claim%ld.txt", i);
+                for (int block = 0; block < MAX_FILE_SIZE/BLOCK_SIZE; block++) {
+                        ret |= block_claim[i][block] == -1;
+                }
+                ret |= removeFile(name_claim) != 0;
+        }
+        if (ret != 0)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST balloc TP-56 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST balloc TP-56 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        ret = unmountFS();
+
+        /////// Check that we cannot synchronize a file system that is not mounted
+        ret = fs_sync();
+        if (ret != -1)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST fs_sync TP-57 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST fs_sync TP-57 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
+        /////// Check that we cannot preallocate when the file system is not mounted
+        ret = fallocateFile(0, 0, BLOCK_SIZE);
+        if (ret != -2)
+	{
+		fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST fallocateFile TP-58 ", ANSI_COLOR_RED, "FAILED\n", ANSI_COLOR_RESET);
+		return -1;
+	}
+	fprintf(stdout, "%s%s%s%s%s", ANSI_COLOR_BLUE, "TEST fallocateFile TP-58 ", ANSI_COLOR_GREEN, "SUCCESS\n", ANSI_COLOR_RESET);
+
 	///////
 
 	return 0;